@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+
+namespace bench
+{
+	//     ,    
+	template <typename T>
+	void DoNotOptimize(T const& value)
+	{
+		if constexpr (std::is_arithmetic_v<T>)
+		{
+			static volatile T sink;
+			sink = value;
+		}
+		else
+		{
+			static volatile const void* sink;
+			sink = &value;
+		}
+	}
+
+	//    ,        
+	template <typename T>
+	T const& Opaque(T const& value)
+	{
+		const T* volatile pointer = &value;
+		return *pointer;
+	}
+
+	/*
+	*  f iterations       
+	*     
+	*/
+	template <typename F>
+	double Measure(const char* name, size_t iterations, F&& f)
+	{
+		using clock = std::chrono::steady_clock;
+
+		auto start = clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			f();
+		std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+
+		double perIteration = elapsed.count() / iterations;
+		std::printf("%-48s %12.1f ns/op\n", name, perIteration);
+		return perIteration;
+	}
+
+	void RunValidationBenchmarks();
+	void RunCompressionBenchmarks();
+	void RunConnectionBenchmarks();
+	void RunReplayBenchmarks();
+	void RunTlsBenchmarks();
+
+	//    ,     
+	void RunReplayBenchmark(std::string const& path);
+}
@@ -0,0 +1,130 @@
+#include "Benchmark.hpp"
+#include "LocalGameServer.hpp"
+
+#include <boost/beast/zlib.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace conn;
+
+namespace bench
+{
+	namespace zlib = beast::zlib;
+
+	// list: reply of a busy lobby in the text protocol
+	static std::string MakePlayerList(size_t count)
+	{
+		std::string list;
+		for (size_t i = 1; i <= count; i++)
+			list += std::to_string(i) + ":player_" + std::to_string(i * 7919 % 100000) + "\n";
+		return list;
+	}
+
+	static std::vector<std::string> MakeChatBurst(size_t count)
+	{
+		std::vector<std::string> burst;
+		for (size_t i = 0; i < count; i++)
+			burst.push_back("server@message:move " + std::to_string(i % 8) + " to " + std::to_string(i * 31 % 64) + " check");
+		return burst;
+	}
+
+	/*
+	*    ,  permessage-deflate:    sync flush
+	*     ,     -   
+	*     
+	*/
+	static size_t Deflate(zlib::deflate_stream& stream, std::vector<std::string> const& messages, int windowBits, bool noContextTakeover)
+	{
+		static std::vector<char> out(1 << 20);
+
+		size_t total = 0;
+		for (size_t i = 0; i < messages.size(); i++)
+		{
+			auto& message = messages[i];
+			if (i == 0 || noContextTakeover)
+				stream.reset(8, windowBits, 4, zlib::Strategy::normal);
+
+			zlib::z_params params;
+			params.next_in = message.data();
+			params.avail_in = message.size();
+			params.next_out = out.data();
+			params.avail_out = out.size();
+
+			beast::error_code ec;
+			stream.write(params, zlib::Flush::sync, ec);
+			total += out.size() - params.avail_out;
+		}
+		return total;
+	}
+
+	static void MeasureDeflate(const char* payload, std::vector<std::string> const& messages, size_t iterations)
+	{
+		size_t raw = 0;
+		for (auto& message : messages)
+			raw += message.size();
+		std::printf("%-48s %12zu bytes\n", (std::string(payload) + ", uncompressed").c_str(), raw);
+
+		for (int windowBits : { 9, 12, 15 })
+		{
+			for (bool noContextTakeover : { false, true })
+			{
+				zlib::deflate_stream stream;
+
+				std::string name = std::string(payload) + ", " + std::to_string(windowBits) + " bits" + (noContextTakeover ? ", no takeover" : "");
+				size_t compressed = 0;
+				Measure(name.c_str(), iterations, [&]() {
+					compressed = Deflate(stream, Opaque(messages), windowBits, noContextTakeover);
+				});
+				std::printf("%-48s %12zu bytes\n", "", compressed);
+			}
+		}
+	}
+
+	static void MeasureGetPlayers(const char* name, size_t players, CompressionOptions compression)
+	{
+		LocalGameServerOptions serverOptions;
+		serverOptions.lobbyPlayers = players;
+		serverOptions.deflate.server_enable = true;
+		serverOptions.deflate.server_max_window_bits = compression.windowBits;
+		serverOptions.deflate.client_max_window_bits = compression.windowBits;
+		serverOptions.deflate.server_no_context_takeover = compression.noContextTakeover;
+		serverOptions.deflate.client_no_context_takeover = compression.noContextTakeover;
+
+		LocalGameServer server(serverOptions);
+
+		ConnectionOptions options;
+		options.compression = compression;
+
+		auto context = std::make_shared<ConnectionContext>(1);
+		{
+			WebSocketAsyncGameConnection connection(context, "127.0.0.1", server.GetPort(), options);
+			connection.Register("bench");
+
+			Measure(name, 2000, [&]() {
+				DoNotOptimize(connection.GetPlayers().size());
+			});
+		}
+	}
+
+	void RunCompressionBenchmarks()
+	{
+		std::printf("\nCompression\n");
+
+		MeasureDeflate("list, 100 players", { "server@list:" + MakePlayerList(100) }, 20000);
+		MeasureDeflate("list, 1000 players", { "server@list:" + MakePlayerList(1000) }, 2000);
+		MeasureDeflate("chat burst, 50 messages", MakeChatBurst(50), 20000);
+
+		CompressionOptions off;
+		MeasureGetPlayers("GetPlayers over loopback, 1000 players", 1000, off);
+
+		CompressionOptions on;
+		on.enabled = true;
+		MeasureGetPlayers("  deflate, 15 bits", 1000, on);
+
+		CompressionOptions bounded = on;
+		bounded.windowBits = 9;
+		bounded.noContextTakeover = true;
+		MeasureGetPlayers("  deflate, 9 bits, no takeover", 1000, bounded);
+	}
+}
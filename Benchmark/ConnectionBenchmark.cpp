@@ -0,0 +1,370 @@
+#include "Benchmark.hpp"
+#include "LocalGameServer.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace conn;
+
+namespace bench
+{
+	using clock = std::chrono::steady_clock;
+
+	//   ,     
+	template <typename F>
+	static void WaitFor(F condition)
+	{
+		auto deadline = clock::now() + std::chrono::seconds(10);
+		while (!condition())
+		{
+			if (clock::now() > deadline)
+				throw std::runtime_error("The local server did not answer in time");
+			std::this_thread::yield();
+		}
+	}
+
+	static double Microseconds(std::chrono::nanoseconds duration)
+	{
+		return duration.count() / 1000.0;
+	}
+
+	static void PrintLatency(std::string const& name, LatencyHistogram::Snapshot const& latency)
+	{
+		std::printf("%-48s p50 %9.1f us   p99 %9.1f us   max %9.1f us\n", name.c_str(),
+			Microseconds(latency.Percentile(0.5)), Microseconds(latency.Percentile(0.99)), Microseconds(latency.Max()));
+	}
+
+	//        
+	struct Game
+	{
+		std::shared_ptr<ConnectionContext> context = std::make_shared<ConnectionContext>(2);
+		std::unique_ptr<WebSocketAsyncGameConnection> a, b;
+
+		Game(LocalGameServer& server, ConnectionOptions options)
+		{
+			a = std::make_unique<WebSocketAsyncGameConnection>(context, "127.0.0.1", server.GetPort(), options);
+			b = std::make_unique<WebSocketAsyncGameConnection>(context, "127.0.0.1", server.GetPort(), options);
+			a->Register("alice");
+			b->Register("bob");
+			Start();
+		}
+
+		void Start()
+		{
+			a->SendOffer(b->GetID());
+			b->SendOffer(a->GetID());
+			WaitFor([&]() {
+				return a->GetState() == GameConnection::State::InGame && b->GetState() == GameConnection::State::InGame;
+			});
+		}
+	};
+
+	static std::vector<String> MakeLines(size_t count)
+	{
+		std::vector<String> lines;
+		lines.reserve(count);
+		for (size_t i = 0; i < count; i++)
+			lines.push_back("move " + std::to_string(i % 64) + " to " + std::to_string(i * 31 % 64));
+		return lines;
+	}
+
+	static void RunRoundTrips(std::string const& protocol, ConnectionOptions options)
+	{
+		LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(2);
+		{
+			WebSocketAsyncGameConnection a(context, "127.0.0.1", server.GetPort(), options);
+			WebSocketAsyncGameConnection b(context, "127.0.0.1", server.GetPort(), options);
+			WebSocketAsyncGameConnection bystander(context, "127.0.0.1", server.GetPort(), options);
+			a.Register("alice");
+			b.Register("bob");
+			bystander.Register("carol");
+
+			Measure((protocol + ", GetPlayers").c_str(), 5000, [&]() {
+				DoNotOptimize(a.GetPlayers().size());
+			});
+			Measure((protocol + ", SendOffer").c_str(), 5000, [&]() {
+				a.SendOffer(bystander.GetID());
+			});
+
+			a.SendOffer(b.GetID());
+			b.SendOffer(a.GetID());
+			WaitFor([&]() { return a.GetState() == GameConnection::State::InGame; });
+
+			Measure((protocol + ", SendMessage").c_str(), 5000, [&]() {
+				a.SendMessage("hello");
+			});
+			Measure((protocol + ", EndGame and new game").c_str(), 1000, [&]() {
+				a.EndGame();
+				WaitFor([&]() { return b.GetState() == GameConnection::State::Searching; });
+				a.SendOffer(b.GetID());
+				b.SendOffer(a.GetID());
+				WaitFor([&]() { return a.GetState() == GameConnection::State::InGame; });
+			});
+
+			ConnectionStats stats = a.GetStats();
+			for (auto& [command, latency] : stats.commandLatency)
+			{
+				if (latency.count)
+					PrintLatency("  " + command, latency);
+			}
+			PrintLatency("  frame handling", stats.frameHandling);
+		}
+	}
+
+	static void RunThroughput(std::string const& name, ConnectionOptions options, bool batch)
+	{
+		const size_t MESSAGES = 20000;
+		const size_t BATCH_SIZE = 100;
+
+		LocalGameServer server;
+		Game game(server, options);
+		std::vector<String> lines = MakeLines(BATCH_SIZE);
+
+		auto start = clock::now();
+		if (batch)
+		{
+			for (size_t sent = 0; sent < MESSAGES; sent += BATCH_SIZE)
+				DoNotOptimize(game.a->SendMessages(lines).size());
+		}
+		else
+		{
+			for (size_t sent = 0; sent < MESSAGES; sent++)
+				game.a->SendMessage(lines[sent % BATCH_SIZE]);
+		}
+		WaitFor([&]() { return game.b->GetStats().inboxDepth == MESSAGES; });
+		std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+
+		std::printf("%-48s %12.1f ns/msg %10.0f msg/s\n", name.c_str(),
+			elapsed.count() / MESSAGES, MESSAGES / (elapsed.count() / 1e9));
+
+		ConnectionStats sender = game.a->GetStats();
+		std::printf("%-48s %12llu frames out\n", "", static_cast<unsigned long long>(sender.framesOut));
+		PrintLatency("  receiver frame handling", game.b->GetStats().frameHandling);
+	}
+
+	static void RunInbox()
+	{
+		const size_t MESSAGES = 1000;
+
+		LocalGameServer server;
+		Game game(server, ConnectionOptions());
+
+		std::vector<String> lines = MakeLines(MESSAGES);
+		game.a->SendMessages(lines);
+		WaitFor([&]() { return game.b->GetStats().inboxDepth == MESSAGES; });
+
+		Measure("GetMessages, 1000 pending", 2000, [&]() {
+			DoNotOptimize(game.b->GetMessages().size());
+		});
+
+		std::vector<Message> messages = game.b->GetMessages();
+		size_t next = 0;
+		Measure("RemoveMessage, 1000 pending", MESSAGES, [&]() {
+			game.b->RemoveMessage(messages[next++].messageId);
+		});
+	}
+
+	/*
+	*    ,    
+	*     ,  PauseReading     
+	*/
+	static void RunInboxLimit(std::string const& name, OverflowPolicy policy)
+	{
+		const size_t MESSAGES = 20000;
+		const size_t BATCH_SIZE = 100;
+
+		ConnectionOptions options;
+		options.preferBinaryProtocol = true;
+		options.inbox.maxMessages = 1000;
+		options.inbox.messagePolicy = policy;
+
+		LocalGameServer server;
+		Game game(server, options);
+		std::vector<String> lines = MakeLines(BATCH_SIZE);
+		for (size_t sent = 0; sent < MESSAGES; sent += BATCH_SIZE)
+			game.a->SendMessages(lines);
+
+		// the receiver starts reading only after everything is sent
+		size_t received = 0;
+		WaitFor([&]() {
+			for (Message const& message : game.b->GetMessages())
+			{
+				game.b->RemoveMessage(message.messageId);
+				received++;
+			}
+			return received + game.b->GetStats().droppedMessages == MESSAGES;
+		});
+
+		ConnectionStats stats = game.b->GetStats();
+		std::printf("%-48s %8zu peak %10llu dropped %6llu pauses\n", name.c_str(), stats.storedMessagesPeak,
+			static_cast<unsigned long long>(stats.droppedMessages), static_cast<unsigned long long>(stats.readPauses));
+	}
+
+	static void RunListParsing(std::string const& protocol, ConnectionOptions options)
+	{
+		LocalGameServerOptions serverOptions;
+		serverOptions.lobbyPlayers = 1000;
+		LocalGameServer server(serverOptions);
+
+		auto context = std::make_shared<ConnectionContext>(1);
+		{
+			WebSocketAsyncGameConnection connection(context, "127.0.0.1", server.GetPort(), options);
+			connection.Register("bench");
+
+			Measure((protocol + ", GetPlayers, 1000 players").c_str(), 2000, [&]() {
+				DoNotOptimize(connection.GetPlayers().size());
+			});
+
+			uint64_t before = connection.GetStats().bytesIn;
+			connection.GetPlayers();
+			ConnectionStats stats = connection.GetStats();
+			std::printf("%-48s %12llu bytes in\n", "", static_cast<unsigned long long>(stats.bytesIn - before));
+			PrintLatency("  frame handling", stats.frameHandling);
+		}
+	}
+
+	/*
+	*   ,     
+	*      
+	*/
+	static void RunReconnect(std::string const& name, ConnectionOptions options)
+	{
+		const size_t DROPS = 50;
+
+		LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		{
+			WebSocketAsyncGameConnection connection(context, "127.0.0.1", server.GetPort(), options);
+			connection.Register("bench");
+
+			for (size_t i = 0; i < DROPS; i++)
+			{
+				server.DropConnections();
+				WaitFor([&]() { return connection.GetStats().reconnects == i + 1; });
+				DoNotOptimize(connection.GetPlayers().size());
+			}
+			PrintLatency(name, connection.GetStats().reconnectTime);
+		}
+	}
+
+	/*
+	*   :       AsyncConnect
+	*  localhost    ,   ::1   ,      
+	*/
+	static void RunStartup(size_t count)
+	{
+		LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(2);
+		std::vector<std::unique_ptr<WebSocketAsyncGameConnection>> connections;
+		connections.reserve(count);
+
+		auto start = clock::now();
+		for (size_t i = 0; i < count; i++)
+			connections.push_back(std::make_unique<WebSocketAsyncGameConnection>(context, "localhost", server.GetPort()));
+		std::chrono::duration<double, std::milli> sequential = clock::now() - start;
+		connections.clear();
+
+		start = clock::now();
+		std::vector<std::future<std::unique_ptr<WebSocketAsyncGameConnection>>> pending;
+		for (size_t i = 0; i < count; i++)
+			pending.push_back(WebSocketAsyncGameConnection::AsyncConnect(context, "localhost", server.GetPort(), ConnectionOptions(), net::use_future));
+		for (auto& connection : pending)
+			connections.push_back(connection.get());
+		std::chrono::duration<double, std::milli> concurrent = clock::now() - start;
+
+		std::printf("%-48s %12.1f ms\n", ("  " + std::to_string(count) + " connections, one by one").c_str(), sequential.count());
+		std::printf("%-48s %12.1f ms\n", ("  " + std::to_string(count) + " connections, AsyncConnect").c_str(), concurrent.count());
+	}
+
+	/*
+	*    ,        
+	*/
+	static void RunDeadlines(double replyLoss, std::chrono::milliseconds timeout)
+	{
+		const size_t CALLS = 2000;
+
+		LocalGameServerOptions serverOptions;
+		serverOptions.replyLoss = replyLoss;
+		LocalGameServer server(serverOptions);
+
+		ConnectionOptions options;
+		options.requestTimeout = timeout;
+
+		auto context = std::make_shared<ConnectionContext>(1);
+		{
+			WebSocketAsyncGameConnection a(context, "127.0.0.1", server.GetPort(), options);
+			WebSocketAsyncGameConnection b(context, "127.0.0.1", server.GetPort(), options);
+			a.Register("alice");
+			b.Register("bob");
+
+			LatencyHistogram latency;
+			size_t timeouts = 0;
+			for (size_t i = 0; i < CALLS; i++)
+			{
+				auto start = clock::now();
+				try
+				{
+					a.SendOffer(b.GetID());
+				}
+				catch (TimeoutException const&)
+				{
+					timeouts++;
+				}
+				latency.Record(clock::now() - start);
+			}
+
+			std::string name = "SendOffer, " + std::to_string(static_cast<int>(replyLoss * 100)) + "% lost, " +
+				std::to_string(timeout.count()) + " ms timeout";
+			PrintLatency(name, latency.GetSnapshot());
+			std::printf("%-48s %12zu timed out\n", "", timeouts);
+		}
+	}
+
+	void RunConnectionBenchmarks()
+	{
+		std::printf("\nStartup\n");
+		RunStartup(200);
+
+		std::printf("\nRound trips\n");
+
+		ConnectionOptions text;
+		ConnectionOptions binary;
+		binary.preferBinaryProtocol = true;
+		ConnectionOptions coalesced = binary;
+		coalesced.coalescing.enabled = true;
+
+		RunRoundTrips("text", text);
+		RunRoundTrips("binary", binary);
+
+		std::printf("\nMessage throughput\n");
+		RunThroughput("text, SendMessage", text, false);
+		RunThroughput("text, SendMessages", text, true);
+		RunThroughput("binary, SendMessages", binary, true);
+		RunThroughput("binary, SendMessages, coalescing", coalesced, true);
+
+		std::printf("\nInbox\n");
+		RunInbox();
+		RunInboxLimit("1000 messages, drop oldest", OverflowPolicy::DropOldest);
+		RunInboxLimit("1000 messages, drop newest", OverflowPolicy::DropNewest);
+		RunInboxLimit("1000 messages, pause reading", OverflowPolicy::PauseReading);
+
+		std::printf("\nList parsing\n");
+		RunListParsing("text", text);
+		RunListParsing("binary", binary);
+
+		std::printf("\nReconnect\n");
+		ConnectionOptions reconnect = binary;
+		reconnect.reconnect.enabled = true;
+		RunReconnect("default backoff", reconnect);
+		reconnect.reconnect.initialDelay = std::chrono::milliseconds(0);
+		RunReconnect("no delay before the first attempt", reconnect);
+
+		std::printf("\nDeadlines\n");
+		RunDeadlines(0, std::chrono::milliseconds(20));
+		RunDeadlines(0.01, std::chrono::milliseconds(20));
+	}
+}
@@ -0,0 +1,544 @@
+#include "LocalGameServer.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/beast/http.hpp>
+
+#include <charconv>
+#include <deque>
+#include <future>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <variant>
+
+#ifdef CONNECTION_TLS
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#endif
+
+using namespace conn;
+
+namespace bench
+{
+	// v the server side of the text protocol v
+	const std::string ERROR_PREFIX = "error: ";
+	const std::string SUCCESS = "success";
+	const std::string ERROR_UNKNOWN_COMMAND = "unknown command";
+	const std::string ERROR_WRONG_STATE = "wrong state";
+	const std::string ERROR_UNKNOWN_ID = "unknown id";
+	const std::string ERROR_WRONG_OPPONENT_STATE = "opponent is not searching for the game";
+	// ^ the server side of the text protocol ^
+
+	// Text prefix of a server message, the same as GameConnection expects
+	static std::string_view EventPrefix(wire::Opcode event)
+	{
+		switch (event)
+		{
+		case wire::Opcode::PlayerId:
+			return "server@id:";
+		case wire::Opcode::NewOffer:
+			return "server@offer:";
+		case wire::Opcode::GameStarted:
+			return "server@in game with:";
+		case wire::Opcode::GameEnded:
+			return "server@end game";
+		case wire::Opcode::NewMessage:
+			return "server@message:";
+		default:
+			return "server@";
+		}
+	}
+
+#ifdef CONNECTION_TLS
+	/*
+	*       P-256     127.0.0.1
+	*        
+	*/
+	static std::unique_ptr<net::ssl::context> MakeSelfSignedContext()
+	{
+		std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> keyContext(EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr), EVP_PKEY_CTX_free);
+		EVP_PKEY* generated = nullptr;
+		if (!keyContext || EVP_PKEY_keygen_init(keyContext.get()) != 1 ||
+			EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext.get(), NID_X9_62_prime256v1) != 1 ||
+			EVP_PKEY_keygen(keyContext.get(), &generated) != 1)
+			throw std::runtime_error("Failed to generate the server key");
+		std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key(generated, EVP_PKEY_free);
+
+		std::unique_ptr<X509, decltype(&X509_free)> certificate(X509_new(), X509_free);
+		X509_set_version(certificate.get(), 2);
+		ASN1_INTEGER_set(X509_get_serialNumber(certificate.get()), 1);
+		X509_gmtime_adj(X509_getm_notBefore(certificate.get()), 0);
+		X509_gmtime_adj(X509_getm_notAfter(certificate.get()), 24 * 60 * 60);
+		X509_set_pubkey(certificate.get(), key.get());
+
+		X509_NAME* name = X509_get_subject_name(certificate.get());
+		X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("127.0.0.1"), -1, -1, 0);
+		X509_set_issuer_name(certificate.get(), name);
+		if (X509_sign(certificate.get(), key.get(), EVP_sha256()) == 0)
+			throw std::runtime_error("Failed to sign the server certificate");
+
+		auto ssl = std::make_unique<net::ssl::context>(net::ssl::context::tls_server);
+		SSL_CTX* handle = ssl->native_handle();
+		if (SSL_CTX_use_certificate(handle, certificate.get()) != 1 || SSL_CTX_use_PrivateKey(handle, key.get()) != 1)
+			throw std::runtime_error("Failed to set the server certificate");
+
+		// TLS 1.2 resumes through the server session cache, which needs an id context, TLS 1.3 uses tickets
+		static const unsigned char SESSION_CONTEXT[] = "LocalGameServer";
+		SSL_CTX_set_session_id_context(handle, SESSION_CONTEXT, sizeof(SESSION_CONTEXT) - 1);
+		return ssl;
+	}
+#endif
+
+	class LocalGameServer::Session : public std::enable_shared_from_this<Session>
+	{
+		std::deque<std::string> writeQueue;
+		bool writing = false;
+
+		void WriteNext()
+		{
+			writing = true;
+			std::visit([this](auto& stream) {
+				stream.async_write(net::buffer(writeQueue.front()), [self = shared_from_this()](beast::error_code const& ec, std::size_t) {
+					self->writeQueue.pop_front();
+					if (ec)
+						self->writeQueue.clear();
+
+					if (self->writeQueue.empty())
+						self->writing = false;
+					else
+						self->WriteNext();
+				});
+			}, ws);
+		}
+	public:
+#ifdef CONNECTION_TLS
+		std::variant<websocket::stream<tcp::socket>, websocket::stream<beast::ssl_stream<tcp::socket>>> ws;
+#else
+		std::variant<websocket::stream<tcp::socket>> ws;
+#endif
+		bool binary = false;
+
+		int id = 0;
+		std::string nickname;
+		bool registered = false;
+		// 0 when the player is not in a game
+		int opponent = 0;
+		std::set<int> offersFrom;
+
+		// LocalGameServerOptions::replyLoss
+		double replyLoss = 0;
+		std::minstd_rand random;
+
+		explicit Session(tcp::socket socket) : ws(std::in_place_index<0>, std::move(socket)) {}
+#ifdef CONNECTION_TLS
+		Session(tcp::socket socket, net::ssl::context& ssl) : ws(std::in_place_index<1>, std::move(socket), ssl) {}
+#endif
+
+		// writes are queued, because other sessions send events to this one at any time
+		void Send(std::string frame)
+		{
+			writeQueue.push_back(std::move(frame));
+			if (!writing)
+				WriteNext();
+		}
+
+		// error is empty on success
+		void SendResponse(uint64_t requestId, std::string_view error)
+		{
+			// the request is executed, only the reply is lost; registration replies are kept, so the players can always be set up
+			if (registered && replyLoss > 0 && std::uniform_real_distribution<double>(0, 1)(random) < replyLoss)
+				return;
+
+			std::string frame;
+			if (binary)
+			{
+				wire::FrameWriter writer(frame);
+				writer.WriteByte(static_cast<uint8_t>(wire::Opcode::Response));
+				writer.WriteVarint(requestId);
+				if (error.empty())
+				{
+					writer.WriteByte(static_cast<uint8_t>(wire::Status::Success));
+				}
+				else
+				{
+					writer.WriteByte(static_cast<uint8_t>(wire::Status::Error));
+					writer.WriteString(error);
+				}
+			}
+			else
+			{
+				frame = std::to_string(requestId) + '@';
+				if (error.empty())
+					frame += SUCCESS;
+				else
+					(frame += ERROR_PREFIX) += error;
+			}
+			Send(std::move(frame));
+		}
+
+		void SendEvent(wire::Opcode event, std::string_view argument = std::string_view())
+		{
+			std::string frame;
+			if (binary)
+			{
+				wire::FrameWriter writer(frame);
+				writer.WriteByte(static_cast<uint8_t>(event));
+				if (event != wire::Opcode::GameEnded)
+					writer.WriteString(argument);
+			}
+			else
+			{
+				frame = EventPrefix(event);
+				frame += argument;
+			}
+			Send(std::move(frame));
+		}
+
+		void SendList(std::vector<std::pair<std::string_view, std::string_view>> const& players)
+		{
+			std::string frame;
+			if (binary)
+			{
+				wire::FrameWriter writer(frame);
+				writer.WriteByte(static_cast<uint8_t>(wire::Opcode::PlayerList));
+				writer.WriteVarint(players.size());
+				for (auto& [playerId, playerNickname] : players)
+				{
+					writer.WriteString(playerId);
+					writer.WriteString(playerNickname);
+				}
+			}
+			else
+			{
+				frame = "server@list:";
+				for (auto& [playerId, playerNickname] : players)
+				{
+					((frame += playerId) += ':') += playerNickname;
+					frame += '\n';
+				}
+			}
+			Send(std::move(frame));
+		}
+	};
+
+	LocalGameServer::LocalGameServer(LocalGameServerOptions options) :
+		acceptor(ioc, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0)), options(options)
+	{
+		// the ids of fake players do not clash with real ones, which count from 1
+		for (size_t i = 0; i < options.lobbyPlayers; i++)
+			lobby.emplace_back("lobby" + std::to_string(i), "player_" + std::to_string(i * 7919 % 100000));
+
+#ifdef CONNECTION_TLS
+		if (options.tls)
+			ssl = MakeSelfSignedContext();
+#endif
+
+		net::co_spawn(ioc, Accept(), net::detached);
+		thread = std::thread([this]() { ioc.run(); });
+	}
+	LocalGameServer::~LocalGameServer()
+	{
+		ioc.stop();
+		thread.join();
+		sessions.clear();
+	}
+
+	std::string LocalGameServer::GetPort() const
+	{
+		return std::to_string(acceptor.local_endpoint().port());
+	}
+
+	void LocalGameServer::DropConnections()
+	{
+		std::promise<void> dropped;
+		net::post(ioc, [this, &dropped]() {
+			for (auto& [sessionId, session] : sessions)
+			{
+				std::visit([](auto& ws) {
+					beast::error_code ec;
+					beast::get_lowest_layer(ws).close(ec);
+				}, session->ws);
+			}
+			dropped.set_value();
+		});
+		dropped.get_future().wait();
+	}
+
+	net::awaitable<void> LocalGameServer::Accept()
+	{
+		for (;;)
+		{
+			tcp::socket socket = co_await acceptor.async_accept(net::use_awaitable);
+			socket.set_option(tcp::no_delay(true));
+#ifdef CONNECTION_TLS
+			if (ssl)
+			{
+				net::co_spawn(ioc, Run(std::make_shared<Session>(std::move(socket), *ssl)), net::detached);
+				continue;
+			}
+#endif
+			net::co_spawn(ioc, Run(std::make_shared<Session>(std::move(socket))), net::detached);
+		}
+	}
+
+	net::awaitable<void> LocalGameServer::Run(std::shared_ptr<Session> session)
+	{
+		session->replyLoss = options.replyLoss;
+		try
+		{
+#ifdef CONNECTION_TLS
+			if (auto tls = std::get_if<1>(&session->ws))
+				co_await tls->next_layer().async_handshake(net::ssl::stream_base::server, net::use_awaitable);
+#endif
+			co_await std::visit([&](auto& ws) { return Serve(*session, ws); }, session->ws);
+		}
+		catch (std::exception const&)
+		{
+			// the client has disconnected
+		}
+
+		if (session->id != 0)
+		{
+			LeaveGame(*session);
+			sessions.erase(session->id);
+		}
+	}
+
+	template <typename Stream>
+	net::awaitable<void> LocalGameServer::Serve(Session& session, Stream& ws)
+	{
+		// the upgrade request is read first to see which subprotocol the client offers
+		beast::flat_buffer buffer;
+		http::request<http::string_body> request;
+		co_await http::async_read(ws.next_layer(), buffer, request, net::use_awaitable);
+
+		std::string offered(request[http::field::sec_websocket_protocol]);
+		session.binary = options.allowBinaryProtocol && offered.find(wire::BINARY_SUBPROTOCOL) != std::string::npos;
+
+		ws.set_option(options.deflate);
+		ws.set_option(websocket::stream_base::decorator(
+			[binary = session.binary](websocket::response_type& response)
+			{
+				if (binary)
+					response.set(http::field::sec_websocket_protocol, std::string(wire::BINARY_SUBPROTOCOL));
+			}));
+		co_await ws.async_accept(request, net::use_awaitable);
+		ws.binary(session.binary);
+
+		session.id = nextId++;
+		sessions[session.id] = session.shared_from_this();
+
+		buffer.clear();
+		for (;;)
+		{
+			co_await ws.async_read(buffer, net::use_awaitable);
+			auto data = buffer.cdata();
+			HandleFrame(session, std::string_view(static_cast<const char*>(data.data()), data.size()));
+			buffer.consume(buffer.size());
+		}
+	}
+
+	void LocalGameServer::HandleFrame(Session& session, std::string_view frame)
+	{
+		if (!session.binary)
+		{
+			HandleTextRequest(session, frame);
+			return;
+		}
+
+		wire::FrameReader reader(frame);
+		uint8_t opcode;
+		if (!reader.ReadByte(opcode))
+			return;
+
+		if (static_cast<wire::Opcode>(opcode) != wire::Opcode::Batch)
+		{
+			HandleBinaryRequest(session, frame);
+			return;
+		}
+
+		uint64_t count;
+		std::string_view request;
+		if (!reader.ReadVarint(count))
+			return;
+		for (uint64_t i = 0; i < count && reader.ReadString(request); i++)
+			HandleBinaryRequest(session, request);
+	}
+
+	void LocalGameServer::HandleTextRequest(Session& session, std::string_view request)
+	{
+		static const std::pair<std::string_view, wire::Opcode> COMMANDS[] = {
+			{ "register", wire::Opcode::Register },
+			{ "list", wire::Opcode::List },
+			{ "offer", wire::Opcode::Offer },
+			{ "message", wire::Opcode::Message },
+			{ "end game", wire::Opcode::EndGame },
+		};
+
+		auto at = request.find('@');
+		if (at == std::string_view::npos)
+			return;
+
+		uint64_t requestId = 0;
+		std::from_chars(request.data(), request.data() + at, requestId);
+		request.remove_prefix(at + 1);
+
+		auto colon = request.find(':');
+		std::string_view command = request.substr(0, colon);
+		std::string_view argument = colon == std::string_view::npos ? std::string_view() : request.substr(colon + 1);
+
+		for (auto& [name, opcode] : COMMANDS)
+		{
+			if (command == name)
+			{
+				Execute(session, opcode, requestId, argument);
+				return;
+			}
+		}
+		session.SendResponse(requestId, ERROR_UNKNOWN_COMMAND);
+	}
+
+	void LocalGameServer::HandleBinaryRequest(Session& session, std::string_view request)
+	{
+		wire::FrameReader reader(request);
+
+		uint8_t opcode;
+		uint64_t requestId;
+		if (!reader.ReadByte(opcode) || !reader.ReadVarint(requestId))
+			return;
+
+		std::string_view argument;
+		if (!reader.AtEnd() && !reader.ReadString(argument))
+		{
+			session.SendResponse(requestId, ERROR_UNKNOWN_COMMAND);
+			return;
+		}
+		Execute(session, static_cast<wire::Opcode>(opcode), requestId, argument);
+	}
+
+	void LocalGameServer::Execute(Session& session, wire::Opcode command, uint64_t requestId, std::string_view argument)
+	{
+		switch (command)
+		{
+		case wire::Opcode::Register:
+		{
+			if (session.registered)
+			{
+				session.SendResponse(requestId, ERROR_WRONG_STATE);
+				return;
+			}
+			session.nickname = argument;
+
+			// the id comes before the reply, so it is known when Register returns
+			session.SendEvent(wire::Opcode::PlayerId, std::to_string(session.id));
+			session.SendResponse(requestId, std::string_view());
+			session.registered = true;
+			return;
+		}
+		case wire::Opcode::List:
+		{
+			std::vector<std::string> ids;
+			std::vector<std::pair<std::string_view, std::string_view>> players;
+			ids.reserve(sessions.size());
+			for (auto& [playerId, player] : sessions)
+			{
+				if (player->registered && player->opponent == 0)
+				{
+					ids.push_back(std::to_string(playerId));
+					players.emplace_back(ids.back(), player->nickname);
+				}
+			}
+			for (auto& [playerId, playerNickname] : lobby)
+				players.emplace_back(playerId, playerNickname);
+
+			session.SendResponse(requestId, std::string_view());
+			session.SendList(players);
+			return;
+		}
+		case wire::Opcode::Offer:
+		{
+			int to = 0;
+			std::from_chars(argument.data(), argument.data() + argument.size(), to);
+			auto it = sessions.find(to);
+			if (it == sessions.end() || !it->second->registered || to == session.id)
+			{
+				session.SendResponse(requestId, ERROR_UNKNOWN_ID);
+				return;
+			}
+			if (!session.registered || session.opponent != 0)
+			{
+				session.SendResponse(requestId, ERROR_WRONG_STATE);
+				return;
+			}
+
+			Session& target = *it->second;
+			if (target.opponent != 0)
+			{
+				session.SendResponse(requestId, ERROR_WRONG_OPPONENT_STATE);
+				return;
+			}
+
+			session.SendResponse(requestId, std::string_view());
+			if (session.offersFrom.count(target.id))
+			{
+				StartGame(session, target);
+			}
+			else
+			{
+				target.offersFrom.insert(session.id);
+				target.SendEvent(wire::Opcode::NewOffer, std::to_string(session.id));
+			}
+			return;
+		}
+		case wire::Opcode::Message:
+		{
+			auto it = sessions.find(session.opponent);
+			if (it == sessions.end())
+			{
+				session.SendResponse(requestId, ERROR_WRONG_STATE);
+				return;
+			}
+			session.SendResponse(requestId, std::string_view());
+			it->second->SendEvent(wire::Opcode::NewMessage, argument);
+			return;
+		}
+		case wire::Opcode::EndGame:
+		{
+			if (session.opponent == 0)
+			{
+				session.SendResponse(requestId, ERROR_WRONG_STATE);
+				return;
+			}
+			session.SendResponse(requestId, std::string_view());
+			LeaveGame(session);
+			return;
+		}
+		default:
+			session.SendResponse(requestId, ERROR_UNKNOWN_COMMAND);
+			return;
+		}
+	}
+
+	void LocalGameServer::StartGame(Session& first, Session& second)
+	{
+		first.opponent = second.id;
+		second.opponent = first.id;
+		first.offersFrom.clear();
+		second.offersFrom.clear();
+
+		first.SendEvent(wire::Opcode::GameStarted, std::to_string(second.id));
+		second.SendEvent(wire::Opcode::GameStarted, std::to_string(first.id));
+	}
+
+	void LocalGameServer::LeaveGame(Session& session)
+	{
+		auto it = sessions.find(session.opponent);
+		session.opponent = 0;
+		if (it == sessions.end())
+			return;
+
+		it->second->opponent = 0;
+		it->second->SendEvent(wire::Opcode::GameEnded);
+	}
+}
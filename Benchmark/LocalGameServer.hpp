@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Connection.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+	struct LocalGameServerOptions
+	{
+		//  permessage-deflate ,    
+		conn::websocket::permessage_deflate deflate;
+
+		//    ,    
+		bool allowBinaryProtocol = true;
+
+		//     ,     list   
+		size_t lobbyPlayers = 0;
+
+		//    ,      ,     
+		double replyLoss = 0;
+
+#ifdef CONNECTION_TLS
+		//    TLS   ,    
+		bool tls = false;
+#endif
+	};
+
+	/*
+	*     
+	*  register, list, offer, message  end game     
+	*     127.0.0.1       
+	*   tls    wss
+	*/
+	class LocalGameServer
+	{
+		class Session;
+
+		conn::net::io_context ioc;
+		conn::tcp::acceptor acceptor;
+		LocalGameServerOptions options;
+#ifdef CONNECTION_TLS
+		std::unique_ptr<conn::net::ssl::context> ssl;
+#endif
+		//  : ID  
+		std::vector<std::pair<std::string, std::string>> lobby;
+
+		//    ID,    
+		std::map<int, std::shared_ptr<Session>> sessions;
+		int nextId = 1;
+
+		std::thread thread;
+
+		conn::net::awaitable<void> Accept();
+		conn::net::awaitable<void> Run(std::shared_ptr<Session> session);
+		//   websocket    , Stream -      
+		template <typename Stream>
+		conn::net::awaitable<void> Serve(Session& session, Stream& ws);
+
+		void HandleFrame(Session& session, std::string_view frame);
+		void HandleTextRequest(Session& session, std::string_view request);
+		void HandleBinaryRequest(Session& session, std::string_view request);
+		void Execute(Session& session, conn::wire::Opcode command, uint64_t requestId, std::string_view argument);
+
+		void StartGame(Session& first, Session& second);
+		void LeaveGame(Session& session);
+	public:
+		explicit LocalGameServer(LocalGameServerOptions options = LocalGameServerOptions());
+		~LocalGameServer();
+
+		LocalGameServer(LocalGameServer const&) = delete;
+		LocalGameServer& operator= (LocalGameServer const&) = delete;
+
+		std::string GetPort() const;
+
+		//      websocket,    ,  ,    
+		void DropConnections();
+	};
+}
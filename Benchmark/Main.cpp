@@ -0,0 +1,29 @@
+#include "Benchmark.hpp"
+
+#include <exception>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+	// Benchmark --replay <capture> replays only the given capture
+	if (argc == 3 && std::string(argv[1]) == "--replay")
+	{
+		try
+		{
+			bench::RunReplayBenchmark(argv[2]);
+			return 0;
+		}
+		catch (std::exception const& e)
+		{
+			std::printf("%s\n", e.what());
+			return 1;
+		}
+	}
+
+	bench::RunValidationBenchmarks();
+	bench::RunCompressionBenchmarks();
+	bench::RunConnectionBenchmarks();
+	bench::RunReplayBenchmarks();
+	bench::RunTlsBenchmarks();
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "Benchmark.hpp"
+#include "LocalGameServer.hpp"
+#include "FrameCapture.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace conn;
+
+namespace bench
+{
+	/*
+	*   ,       
+	*   ,         
+	*/
+	static void RecordCapture(std::string const& path, bool binary)
+	{
+		LocalGameServerOptions serverOptions;
+		serverOptions.lobbyPlayers = 100;
+		LocalGameServer server(serverOptions);
+
+		ConnectionOptions options;
+		options.preferBinaryProtocol = binary;
+		ConnectionOptions recorded = options;
+		recorded.capture.path = path;
+
+		auto context = std::make_shared<ConnectionContext>(2);
+		WebSocketAsyncGameConnection sender(context, "127.0.0.1", server.GetPort(), options);
+		WebSocketAsyncGameConnection receiver(context, "127.0.0.1", server.GetPort(), recorded);
+		sender.Register("alice");
+		receiver.Register("bob");
+
+		for (int i = 0; i < 100; i++)
+			DoNotOptimize(receiver.GetPlayers().size());
+
+		sender.SendOffer(receiver.GetID());
+		receiver.SendOffer(sender.GetID());
+		while (sender.GetState() != GameConnection::State::InGame)
+			std::this_thread::yield();
+
+		std::vector<String> lines;
+		for (size_t i = 0; i < 100; i++)
+			lines.push_back("move " + std::to_string(i % 64) + " to " + std::to_string(i * 31 % 64));
+		for (int i = 0; i < 20; i++)
+			sender.SendMessages(lines);
+
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (receiver.GetStats().inboxDepth < 2000)
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				throw std::runtime_error("The local server did not deliver the messages in time");
+			std::this_thread::yield();
+		}
+	}
+
+	void RunReplayBenchmark(std::string const& path)
+	{
+		FrameCaptureReader capture(path);
+
+		size_t inbound = 0, outbound = 0;
+		CapturedFrame frame;
+		while (capture.Next(frame))
+			(frame.direction == CaptureDirection::Inbound ? inbound : outbound)++;
+		std::printf("%-48s %12zu in %10zu out, %s protocol\n", path.c_str(), inbound, outbound, capture.IsBinaryProtocol() ? "binary" : "text");
+
+		auto context = std::make_shared<ConnectionContext>(1);
+		auto connection = WebSocketAsyncGameConnection::CreateOffline(context, capture.IsBinaryProtocol());
+
+		// the inbox is emptied after every pass, so the passes do the same work
+		size_t messages = 0;
+		double perPass = Measure("  replay and inbox drain", 200, [&]() {
+			ReplayCapture(capture, *connection);
+			if (connection->GetState() != GameConnection::State::InGame)
+				return;
+
+			std::vector<Message> pending = connection->GetMessages();
+			messages = pending.size();
+			for (auto& message : pending)
+				connection->RemoveMessage(message.messageId);
+		});
+		std::printf("%-48s %12.1f ns/frame %8zu messages\n", "", inbound ? perPass / inbound : 0.0, messages);
+
+		ConnectionStats stats = connection->GetStats();
+		std::printf("%-48s p50 %9.1f us   p99 %9.1f us   %llu unhandled\n", "  frame handling",
+			stats.frameHandling.Percentile(0.5).count() / 1000.0, stats.frameHandling.Percentile(0.99).count() / 1000.0,
+			static_cast<unsigned long long>(stats.unhandledServerMessages + stats.parseErrors));
+	}
+
+	void RunReplayBenchmarks()
+	{
+		std::printf("\nReplay\n");
+
+		for (bool binary : { false, true })
+		{
+			std::string path = (std::filesystem::temp_directory_path() / (binary ? "connection-binary.gcap" : "connection-text.gcap")).string();
+			RecordCapture(path, binary);
+			RunReplayBenchmark(path);
+			std::filesystem::remove(path);
+		}
+	}
+}
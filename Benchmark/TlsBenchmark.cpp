@@ -0,0 +1,72 @@
+#include "Benchmark.hpp"
+#include "LocalGameServer.hpp"
+
+#include <memory>
+#include <string>
+
+using namespace conn;
+
+namespace bench
+{
+#ifdef CONNECTION_TLS
+	static const size_t CONNECTIONS = 200;
+
+	/*
+	*       CONNECTIONS  ,    
+	*           
+	*/
+	static void MeasureConnect(std::string const& name, LocalGameServer& server, ConnectionOptions const& options)
+	{
+		auto context = std::make_shared<ConnectionContext>(1);
+		LatencyHistogram connect;
+		size_t resumed = 0;
+		for (size_t i = 0; i < CONNECTIONS; i++)
+		{
+			WebSocketAsyncGameConnection connection(context, "127.0.0.1", server.GetPort(), options);
+			ConnectionStats stats = connection.GetStats();
+			connect.Record(stats.connectTime);
+			if (stats.tlsSessionReused)
+				resumed++;
+		}
+
+		LatencyHistogram::Snapshot latency = connect.GetSnapshot();
+		std::printf("%-48s p50 %9.1f us   p99 %9.1f us   %zu/%zu resumed\n", name.c_str(),
+			latency.Percentile(0.5).count() / 1000.0, latency.Percentile(0.99).count() / 1000.0, resumed, CONNECTIONS);
+	}
+
+	static ConnectionOptions TlsConnection(bool sessionResumption, std::string const& cipherSuites = std::string())
+	{
+		TlsOptions tls;
+		// the local server has a self-signed certificate
+		tls.verifyPeer = false;
+		tls.sessionResumption = sessionResumption;
+		tls.cipherSuites = cipherSuites;
+
+		ConnectionOptions options;
+		options.tls = std::make_shared<TlsContext>(tls);
+		return options;
+	}
+
+	void RunTlsBenchmarks()
+	{
+		std::printf("\nTLS connect\n");
+
+		LocalGameServer plainServer;
+		MeasureConnect("ws", plainServer, ConnectionOptions());
+
+		LocalGameServerOptions serverOptions;
+		serverOptions.tls = true;
+		LocalGameServer server(serverOptions);
+
+		// the first connection of a shared context always makes a full handshake
+		MeasureConnect("wss, full handshake", server, TlsConnection(false));
+		MeasureConnect("wss, resumed session", server, TlsConnection(true));
+		MeasureConnect("wss, resumed session, chacha20-poly1305", server, TlsConnection(true, "TLS_CHACHA20_POLY1305_SHA256"));
+	}
+#else
+	void RunTlsBenchmarks()
+	{
+		std::printf("\nTLS connect\n%-48s\n", "  skipped, built without CONNECTION_TLS");
+	}
+#endif
+}
@@ -0,0 +1,68 @@
+#include "Benchmark.hpp"
+#include "Connection.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace conn;
+
+namespace bench
+{
+	// the per-character loop GameConnection::IsValidMessage used before the vector kernels
+	static bool IsValidMessageReference(std::string const& message)
+	{
+		for (auto& c : message)
+		{
+			if ((c >= '' && c <= '') || (c >= '' && c <= '') ||
+				(c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+				(c >= '0' && c <= '9') ||
+				c == ' ' || c == '-' || c == '_')
+				continue;
+			return false;
+		}
+		return true;
+	}
+
+	static std::string MakeMessage(size_t size)
+	{
+		const std::string alphabet = " hello-world_123  ";
+
+		std::string message;
+		message.reserve(size);
+		while (message.size() < size)
+			message += alphabet[message.size() % alphabet.size()];
+		return message;
+	}
+
+	void RunValidationBenchmarks()
+	{
+		std::printf("Validation\n");
+
+		for (size_t size : { 8, 32, 128, 1024 })
+		{
+			std::string message = MakeMessage(size);
+			size_t iterations = 50'000'000 / size;
+
+			std::string name = "reference loop, " + std::to_string(size) + " bytes";
+			double reference = Measure(name.c_str(), iterations, [&]() {
+				DoNotOptimize(IsValidMessageReference(Opaque(message)));
+			});
+
+			name = "IsValidMessage, " + std::to_string(size) + " bytes";
+			double vectorized = Measure(name.c_str(), iterations, [&]() {
+				DoNotOptimize(GameConnection::IsValidMessage(Opaque(message)));
+			});
+
+			std::printf("%-48s %12.2fx\n", "speedup", reference / vectorized);
+		}
+
+		std::vector<String> batch(1000, MakeMessage(32));
+		Measure("AreValidMessages, 1000 x 32 bytes", 2000, [&]() {
+			DoNotOptimize(GameConnection::AreValidMessages(Opaque(batch)));
+		});
+		Measure("reference loop, 1000 x 32 bytes", 2000, [&]() {
+			for (auto& message : Opaque(batch))
+				DoNotOptimize(IsValidMessageReference(Opaque(message)));
+		});
+	}
+}
@@ -1,19 +1,40 @@
 #include "Connection.hpp"
+#include "FrameCapture.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <unordered_set>
+#include <deque>
+#include <iterator>
+#include <shared_mutex>
+#include <condition_variable>
+#include <istream>
+#include <ostream>
+
+// vector kernels for IsValidMessage, the scalar version is used on other platforms
+#if defined(__AVX2__)
+#define CONNECTION_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CONNECTION_SIMD_SSE2
+#include <emmintrin.h>
+#endif
 
 #undef ERROR
 #undef ERROR_INVALID_MESSAGE
 
 namespace conn
 {
-	std::vector<std::string> SplitBy(std::string const& str, const char delim)
+	// the returned views point into str
+	std::vector<std::string_view> SplitBy(std::string_view str, const char delim)
 	{
 		size_t start;
 		size_t end = 0;
 
-		std::vector<std::string> res;
-		while ((start = str.find_first_not_of(delim, end)) != std::string::npos)
+		std::vector<std::string_view> res;
+		while ((start = str.find_first_not_of(delim, end)) != std::string_view::npos)
 		{
 			end = str.find(delim, start);
 			res.push_back(str.substr(start, end - start));
@@ -21,9 +42,126 @@ namespace conn
 		return res;
 	}
 
-	bool StartsWith(std::string str, std::string sw)
+	bool StartsWith(std::string_view str, std::string_view sw)
+	{
+		return str.substr(0, sw.size()) == sw;
+	}
+
+
+	/*
+	*  ID ,       PlayerID,    
+	*  0   ID   
+	*/
+	struct PlayerIDTable
+	{
+		std::shared_mutex mutex;
+		// the keys are views into the entries, which are not moved while they are in the table
+		std::unordered_map<std::string_view, std::unique_ptr<PlayerID::Entry>> entries;
+		// numbers of removed ids, they are given to new ones first
+		std::vector<uint32_t> freeHandles;
+		uint32_t nextHandle = 1;
+	};
+
+	static PlayerIDTable& GetPlayerIDTable()
+	{
+		static PlayerIDTable table;
+		return table;
+	}
+
+	//    ,       
+	static bool TryAcquire(std::atomic<uint32_t>& references)
+	{
+		uint32_t current = references.load(std::memory_order_relaxed);
+		while (current != 0)
+		{
+			if (references.compare_exchange_weak(current, current + 1, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	PlayerID::PlayerID(std::string_view id)
+	{
+		if (id.empty())
+			return;
+
+		PlayerIDTable& table = GetPlayerIDTable();
+		{
+			// an entry is deleted only under the exclusive lock, so it stays valid here
+			std::shared_lock<std::shared_mutex> lock(table.mutex);
+			auto it = table.entries.find(id);
+			if (it != table.entries.end() && TryAcquire(it->second->references))
+			{
+				entry = it->second.get();
+				return;
+			}
+		}
+
+		std::unique_lock<std::shared_mutex> lock(table.mutex);
+		// another thread could add the same id between the locks
+		auto it = table.entries.find(id);
+		if (it != table.entries.end())
+		{
+			if (TryAcquire(it->second->references))
+			{
+				entry = it->second.get();
+				return;
+			}
+			// the last reference is being released, its owner deletes the detached entry, and the id gets a new one
+			it->second.release();
+			table.entries.erase(it);
+		}
+
+		uint32_t handle;
+		if (!table.freeHandles.empty())
+		{
+			handle = table.freeHandles.back();
+			table.freeHandles.pop_back();
+		}
+		else
+		{
+			if (table.nextHandle == UINT32_MAX)
+				throw ConnectionException("Too many player ids");
+			handle = table.nextHandle++;
+		}
+
+		auto created = std::make_unique<Entry>();
+		created->id = String(id);
+		created->handle = handle;
+		created->references.store(1, std::memory_order_relaxed);
+		entry = created.get();
+		table.entries.emplace(entry->id, std::move(created));
+	}
+
+	void PlayerID::RemoveEntry()
+	{
+		PlayerIDTable& table = GetPlayerIDTable();
+		std::unique_lock<std::shared_mutex> lock(table.mutex);
+		table.freeHandles.push_back(entry->handle);
+		auto it = table.entries.find(entry->id);
+		if (it != table.entries.end() && it->second.get() == entry)
+			table.entries.erase(it);
+		else
+			delete entry;
+		entry = nullptr;
+	}
+
+	String const& PlayerID::ToString() const
+	{
+		static const String EMPTY_ID;
+		return entry ? entry->id : EMPTY_ID;
+	}
+
+	std::ostream& operator<< (std::ostream& out, PlayerID const& id)
+	{
+		return out << id.ToString();
+	}
+	std::istream& operator>> (std::istream& in, PlayerID& id)
 	{
-		return str.rfind(sw, 0) == 0;
+		String str;
+		if (in >> str)
+			id = PlayerID(str);
+		return in;
 	}
 
 
@@ -54,6 +192,11 @@ namespace conn
 	const String NEW_OFFER = "offer:"; // + <id>
 	// ^ other messages ^
 
+	// v errors of the requests finished by the client itself, the response is ERROR + reason v
+	const String REQUEST_TIMED_OUT = "request timed out";
+	const String REQUEST_CANCELLED = "operation cancelled";
+	// ^ errors of the requests finished by the client itself ^
+
 	// v commands from the player v
 	const String COMMAND_REGISTER = "register";    // data = <nickname>
 	const String COMMAND_LIST = "list";
@@ -63,20 +206,116 @@ namespace conn
 	// ^ commands from the player ^
 
 
-	bool GameConnection::IsValidMessage(String message)
+	constexpr bool IsValidChar(char c)
+	{
+		return (c >= '' && c <= '') || (c >= '' && c <= '') ||
+			(c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			(c >= '0' && c <= '9') ||
+			c == ' ' || c == '-' || c == '_';
+	}
+
+	// IsValidChar for every byte value, used for the tails which are shorter than a vector register
+	struct ValidCharTable
 	{
-		for (auto& c : message)
+		bool valid[256];
+
+		constexpr ValidCharTable() : valid()
 		{
-			if ((c >= '' && c <= '') || (c >= '' && c <= '') ||
-				(c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
-				(c >= '0' && c <= '9') ||
-				c == ' ' || c == '-' || c == '_')
-				continue;
-			return false;
+			for (int i = 0; i < 256; i++)
+				valid[i] = IsValidChar(static_cast<char>(i));
 		}
+	};
+	constexpr ValidCharTable VALID_CHARS;
+
+	// the vector kernels check the russian letters as one range of bytes
+	static_assert(static_cast<unsigned char>('') == 0xC0 && static_cast<unsigned char>('') == 0xFF,
+		"Connection.cpp must be compiled with the windows-1251 execution character set");
+
+	bool IsValidTail(const char* data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			if (!VALID_CHARS.valid[static_cast<unsigned char>(data[i])])
+				return false;
 		return true;
 	}
-	bool GameConnection::IsValidNickname(String nickname)
+
+#if defined(CONNECTION_SIMD_AVX2)
+	// mask of the valid bytes: 0xC0-0xFF, a-z, A-Z, 0-9, ' ', '-', '_'
+	inline __m256i ValidCharMask(__m256i v)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+
+		// unsigned x in [lo, lo + span] <=> saturated (x - lo) - span == 0
+		__m256i russian = _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(char(0xC0))), v);
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i latin = _mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_sub_epi8(lower, _mm256_set1_epi8('a')), _mm256_set1_epi8('z' - 'a')), zero);
+		__m256i digit = _mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), _mm256_set1_epi8('9' - '0')), zero);
+		__m256i other = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'))),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+
+		return _mm256_or_si256(_mm256_or_si256(russian, latin), _mm256_or_si256(digit, other));
+	}
+
+	bool IsValidChars(const char* data, size_t size)
+	{
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			if (_mm256_movemask_epi8(ValidCharMask(v)) != -1)
+				return false;
+		}
+		return IsValidTail(data + i, size - i);
+	}
+#elif defined(CONNECTION_SIMD_SSE2)
+	// mask of the valid bytes: 0xC0-0xFF, a-z, A-Z, 0-9, ' ', '-', '_'
+	inline __m128i ValidCharMask(__m128i v)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		// unsigned x in [lo, lo + span] <=> saturated (x - lo) - span == 0
+		__m128i russian = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(char(0xC0))), v);
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i latin = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(lower, _mm_set1_epi8('a')), _mm_set1_epi8('z' - 'a')), zero);
+		__m128i digit = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(v, _mm_set1_epi8('0')), _mm_set1_epi8('9' - '0')), zero);
+		__m128i other = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('-'))),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+
+		return _mm_or_si128(_mm_or_si128(russian, latin), _mm_or_si128(digit, other));
+	}
+
+	bool IsValidChars(const char* data, size_t size)
+	{
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			if (_mm_movemask_epi8(ValidCharMask(v)) != 0xFFFF)
+				return false;
+		}
+		return IsValidTail(data + i, size - i);
+	}
+#else
+	bool IsValidChars(const char* data, size_t size)
+	{
+		return IsValidTail(data, size);
+	}
+#endif
+
+	bool GameConnection::IsValidMessage(std::string_view message)
+	{
+		return IsValidChars(message.data(), message.size());
+	}
+	std::vector<bool> GameConnection::AreValidMessages(std::span<const String> messages)
+	{
+		std::vector<bool> res(messages.size());
+		for (size_t i = 0; i < messages.size(); i++)
+			res[i] = IsValidChars(messages[i].data(), messages[i].size());
+		return res;
+	}
+	bool GameConnection::IsValidNickname(std::string_view nickname)
 	{
 		if (MAX_NICKNAME_SIZE != -1)
 			return IsValidMessage(nickname);
@@ -97,10 +336,10 @@ namespace conn
 		if (GetState() == State::Registration)
 			throw StateException("Wrong state: player must be registered");
 
-		return id;
+		return _GetID();
 	}
 
-	void GameConnection::Register(String nickname)
+	void GameConnection::Register(String nickname, CallOptions const& call)
 	{
 		if (!IsValidNickname(nickname))
 			throw NicknameException("Invalid nickname");
@@ -109,28 +348,28 @@ namespace conn
 		if (GetState() != State::Registration)
 			throw StateException("Wrong state: player must not be registered");
 
-		_Register(nickname);
+		_Register(nickname, call);
 	}
 
 
-	std::vector<Player> GameConnection::GetPlayers()
+	std::vector<Player> GameConnection::GetPlayers(CallOptions const& call)
 	{
 		if (GetState() == State::NotConnected)
 			throw StateException("Wrong state: connection to the server is not established");
 		if (GetState() != State::Searching)
 			throw StateException("Wrong state: player must be in search for the game");
 
-		return _GetPlayers();
+		return _GetPlayers(call);
 	}
 
-	void GameConnection::SendOffer(PlayerID sendTo)
+	void GameConnection::SendOffer(PlayerID sendTo, CallOptions const& call)
 	{
 		if (GetState() == State::NotConnected)
 			throw StateException("Wrong state: connection to the server is not established");
 		if (GetState() != State::Searching)
 			throw StateException("Wrong state: player must be in search for the game");
 
-		_SendOffer(sendTo);
+		_SendOffer(sendTo, call);
 	}
 	std::vector<PlayerID> GameConnection::GetOffers()
 	{
@@ -183,7 +422,7 @@ namespace conn
 	}
 #endif
 
-	void GameConnection::SendMessage(String message)
+	void GameConnection::SendMessage(String message, CallOptions const& call)
 	{
 		if (!IsValidMessage(message))
 			throw MessageException("Invalid message");
@@ -193,299 +432,2326 @@ namespace conn
 		if (GetState() != State::InGame)
 			throw StateException("Wrong state: player must be in the game");
 
-		_SendMessage(message);
+		_SendMessage(message, call);
 	}
 
-	void GameConnection::EndGame()
+	void GameConnection::EndGame(CallOptions const& call)
 	{
 		if (GetState() == State::NotConnected)
 			throw StateException("Wrong state: connection to the server is not established");
 		if (GetState() != State::InGame)
 			throw StateException("Wrong state: player must be in the game");
 
-		_EndGame();
+		_EndGame(call);
 	}
 
-
-	void WebSocketAsyncGameConnection::ParseServerMessage(std::string message)
+	void GameConnection::OnMessage(MessageCallback callback)
 	{
-		if (StartsWith(message, PLAYER_ID))
-		{
-			id = message.substr(PLAYER_ID.size());
-		}
-		else if (StartsWith(message, LIST))
-		{
-			listResponse = message.substr(LIST.size());
-			listUpdated = true;
-		}
-		else if (StartsWith(message, NEW_OFFER))
-		{
-			offers.push_back(message.substr(NEW_OFFER.size()));
-		}
-		else if (StartsWith(message, IN_GAME_WITH))
-		{
-			opponentID = message.substr(IN_GAME_WITH.size());
-			state = State::InGame;
-
-#ifdef _DEBUG
-			parsedMessages.clear();
-#endif
-			unparsedMessages.clear();
-
-			offers.clear();
-		}
-		else if (StartsWith(message, END_GAME))
-		{
-#ifdef _DEBUG
-			parsedMessages.clear();
-#endif
-			unparsedMessages.clear();
+		std::lock_guard<std::mutex> lock(eventMutex);
+		messageCallback = std::move(callback);
+	}
+	void GameConnection::OnOffer(OfferCallback callback)
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		offerCallback = std::move(callback);
+	}
+	void GameConnection::OnGameStarted(GameStartedCallback callback)
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		gameStartedCallback = std::move(callback);
+	}
+	void GameConnection::OnGameEnded(GameEndedCallback callback)
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		gameEndedCallback = std::move(callback);
+	}
 
-			offers.clear();
+	void GameConnection::OnHighWaterMark(HighWaterMarkCallback callback)
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		highWaterMarkCallback = std::move(callback);
+	}
 
-			opponentID = PlayerID();
+	void GameConnection::SetEventExecutor(net::any_io_executor executor)
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		eventExecutor = std::move(executor);
+	}
 
-			state = State::Searching;
-		}
-		else if (StartsWith(message, NEW_MESSAGE))
-		{
-			MessageID messageID = GetMessageID();
-			unparsedMessages.insert(std::make_pair(messageID, Message(opponentID, messageID, message.substr(NEW_MESSAGE.size()))));
-		}
-		else
-		{
-			throw UnhandledServerMessageException("Unrecognised server message: " + message);
-		}
+	bool GameConnection::HasMessageCallback()
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		return static_cast<bool>(messageCallback);
 	}
-	void WebSocketAsyncGameConnection::ParseResponse(std::string id, std::string message)
+	void GameConnection::NotifyMessage(Message const& message)
 	{
-		MessageID messageID = std::stoi(id);
-		responses[messageID] = message;
+		Notify(&GameConnection::messageCallback, message);
 	}
-	void WebSocketAsyncGameConnection::ParseMessage(std::string message)
+	void GameConnection::NotifyOffer(PlayerID const& from)
 	{
-		auto at = message.find('@');
-		std::string id = message.substr(0, at);
-		message = message.substr(at + 1);
+		Notify(&GameConnection::offerCallback, from);
+	}
+	void GameConnection::NotifyGameStarted(PlayerID const& opponent)
+	{
+		Notify(&GameConnection::gameStartedCallback, opponent);
+	}
+	void GameConnection::NotifyGameEnded()
+	{
+		Notify(&GameConnection::gameEndedCallback);
+	}
+	void GameConnection::NotifyHighWaterMark(LimitedList list, size_t size)
+	{
+		Notify(&GameConnection::highWaterMarkCallback, list, size);
+	}
 
-		std::lock_guard<std::mutex> lock(dataMutex);
-		if (id == "server")
-			ParseServerMessage(message);
-		else
-			ParseResponse(id, message);
+	net::awaitable<void> GameConnection::RegisterAsync(String nickname, CallOptions call)
+	{
+		if (!IsValidNickname(nickname))
+			throw NicknameException("Invalid nickname");
+		if (GetState() == State::NotConnected)
+			throw StateException("Wrong state: connection to the server is not established");
+		if (GetState() != State::Registration)
+			throw StateException("Wrong state: player must not be registered");
+
+		co_await _RegisterAsync(std::move(nickname), std::move(call));
 	}
 
-	void WebSocketAsyncGameConnection::MessageHandler(
-		beast::error_code const& ec,		// Result of operation
-		std::size_t bytes_written			// Number of bytes appended to buffer
-	)
+	net::awaitable<std::vector<Player>> GameConnection::GetPlayersAsync(CallOptions call)
 	{
-		if (ec)
-			return;
+		if (GetState() == State::NotConnected)
+			throw StateException("Wrong state: connection to the server is not established");
+		if (GetState() != State::Searching)
+			throw StateException("Wrong state: player must be in search for the game");
 
-		std::string data = beast::buffers_to_string(buffer.data());
-		buffer.clear();
-		ParseMessage(data);
+		co_return co_await _GetPlayersAsync(std::move(call));
+	}
 
-		ws.async_read(
-			buffer,
-			[&](beast::error_code const& ec, std::size_t bytes_written) {
-				this->MessageHandler(ec, bytes_written);
-			});
+	net::awaitable<void> GameConnection::SendOfferAsync(PlayerID sendTo, CallOptions call)
+	{
+		if (GetState() == State::NotConnected)
+			throw StateException("Wrong state: connection to the server is not established");
+		if (GetState() != State::Searching)
+			throw StateException("Wrong state: player must be in search for the game");
+
+		co_await _SendOfferAsync(std::move(sendTo), std::move(call));
 	}
 
-	void WebSocketAsyncGameConnection::RecieveMessages()
+	// Splits the batch into messages to send and MessageException results for invalid ones
+	static std::vector<String> SelectValidMessages(std::span<const String> messages, std::vector<std::exception_ptr>& results)
 	{
-		while (!stopRecieving)
-		{
-			ioc.poll();
+		std::vector<bool> valid = GameConnection::AreValidMessages(messages);
 
-			using namespace std::chrono_literals;
-			std::this_thread::sleep_for(20ms);
+		results.assign(messages.size(), nullptr);
+		std::vector<String> toSend;
+		toSend.reserve(messages.size());
+		for (size_t i = 0; i < messages.size(); i++)
+		{
+			if (valid[i])
+				toSend.push_back(messages[i]);
+			else
+				results[i] = std::make_exception_ptr(MessageException("Invalid message"));
 		}
+		return toSend;
 	}
 
-	void WebSocketAsyncGameConnection::Connect()
+	// Puts the results of the sent messages in place of the valid ones
+	static void MergeResults(std::vector<std::exception_ptr>& results, std::vector<std::exception_ptr> const& sent)
 	{
-		state = State::NotConnected;
-		try
+		auto it = sent.begin();
+		for (auto& result : results)
 		{
-			try
-			{
-				// Make the connection on the IP address we get from a lookup
-				net::connect(ws.next_layer(), results.begin(), results.end());
-			}
-			catch (std::exception const& e)
-			{
-				std::string s = e.what();
-				throw ConnectionException("Failed to connect to the server: " + s);
-			}
-
-			// Set a decorator to change the User-Agent of the handshake
-			ws.set_option(websocket::stream_base::decorator(
-				[](websocket::request_type& req)
-				{
-					req.set(http::field::user_agent,
-						std::string(BOOST_BEAST_VERSION_STRING) +
-						" websocket-client-coro");
-				}));
-
-			// Perform the websocket handshake
-			ws.handshake(url, "/");
+			if (!result)
+				result = *it++;
+		}
+	}
 
-			ws.async_read(
-				buffer,
-				[&](beast::error_code const& ec, std::size_t bytes_written) {
-					this->MessageHandler(ec, bytes_written);
-				});
+	std::vector<std::exception_ptr> GameConnection::SendMessages(std::span<const String> messages, CallOptions const& call)
+	{
+		if (GetState() == State::NotConnected)
+			throw StateException("Wrong state: connection to the server is not established");
+		if (GetState() != State::InGame)
+			throw StateException("Wrong state: player must be in the game");
 
-			state = State::Registration;
+		std::vector<std::exception_ptr> results;
+		std::vector<String> toSend = SelectValidMessages(messages, results);
+		if (!toSend.empty())
+			MergeResults(results, _SendMessages(std::move(toSend), call));
+		return results;
+	}
+	net::awaitable<std::vector<std::exception_ptr>> GameConnection::SendMessagesAsync(std::span<const String> messages, CallOptions call)
+	{
+		if (GetState() == State::NotConnected)
+			throw StateException("Wrong state: connection to the server is not established");
+		if (GetState() != State::InGame)
+			throw StateException("Wrong state: player must be in the game");
 
-			recieverThread = std::thread([&]() { this->RecieveMessages(); });
-		}
-		catch (std::exception const& e)
-		{
-			throw ConnectionException(e.what());
-		}
+		std::vector<std::exception_ptr> results;
+		std::vector<String> toSend = SelectValidMessages(messages, results);
+		if (!toSend.empty())
+			MergeResults(results, co_await _SendMessagesAsync(std::move(toSend), std::move(call)));
+		co_return results;
 	}
 
-	MessageID WebSocketAsyncGameConnection::GetMessageID()
+	net::awaitable<void> GameConnection::SendMessageAsync(String message, CallOptions call)
 	{
-		static MessageID nextMessageID = 0;
-		return nextMessageID++;
+		if (!IsValidMessage(message))
+			throw MessageException("Invalid message");
+
+		if (GetState() == State::NotConnected)
+			throw StateException("Wrong state: connection to the server is not established");
+		if (GetState() != State::InGame)
+			throw StateException("Wrong state: player must be in the game");
+
+		co_await _SendMessageAsync(std::move(message), std::move(call));
 	}
 
-	void WebSocketAsyncGameConnection::Send(String message)
+	net::awaitable<void> GameConnection::EndGameAsync(CallOptions call)
 	{
-		MessageID messageID = GetMessageID();
+		if (GetState() == State::NotConnected)
+			throw StateException("Wrong state: connection to the server is not established");
+		if (GetState() != State::InGame)
+			throw StateException("Wrong state: player must be in the game");
 
-		message = std::to_string(messageID) + '@' + message;
+		co_await _EndGameAsync(std::move(call));
+	}
 
-		try
-		{
-			ws.write(net::buffer(std::string(message)));
-			String response;
-			while (true)
-			{
-				dataMutex.lock();
-				if (responses.count(messageID) > 0)
-				{
-					response = responses[messageID];
-					responses.erase(messageID);
-					dataMutex.unlock();
-					break;
-				}
-				dataMutex.unlock();
 
-				using namespace std::chrono_literals;
-				std::this_thread::sleep_for(20ms);
-			}
+	ConnectionContext::ConnectionContext(size_t threadCount)
+	{
+		threadCount = std::max<size_t>(threadCount, 1);
 
-			if (StartsWith(response, ERROR))
-			{
-				String error = response.substr(ERROR.size());
-				throw ConnectionException(error);
-			}
-		}
-		catch (ConnectionException const& e)
-		{
-			throw e;
-		}
-		catch (std::exception const& e)
+		threads.reserve(threadCount);
+		for (size_t i = 0; i < threadCount; i++)
 		{
-			throw ConnectionException(e.what());
+			// Blocks in the reactor and wakes up only on I/O, returns after the work guard is released
+			threads.emplace_back([this]() { ioc.run(); });
 		}
 	}
-	void WebSocketAsyncGameConnection::Send(String command, String data)
+	ConnectionContext::~ConnectionContext()
 	{
-		Send(command + ':' + data);
+		work.reset();
+		for (auto& thread : threads)
+			thread.join();
 	}
 
-	WebSocketAsyncGameConnection::WebSocketAsyncGameConnection() : url(DEFAULT_URL), port(DEFAULT_PORT), resolver(ioc), ws(ioc), results(resolver.resolve(url, port))
+	net::io_context& ConnectionContext::GetIoContext()
 	{
-		Connect();
+		return ioc;
 	}
-	WebSocketAsyncGameConnection::WebSocketAsyncGameConnection(std::string url, std::string port) : url(url), port(port), resolver(ioc), ws(ioc), results(resolver.resolve(url, port))
+	size_t ConnectionContext::GetThreadCount() const
 	{
-		Connect();
+		return threads.size();
 	}
-	WebSocketAsyncGameConnection::~WebSocketAsyncGameConnection()
+
+	struct CancellationToken::State
+	{
+		std::mutex mutex;
+		std::condition_variable callbackFinished;
+		bool cancelled = false;
+		uint64_t nextSubscription = 1;
+		std::map<uint64_t, std::function<void()>> callbacks;
+
+		// ,    Cancel,   
+		uint64_t running = 0;
+		std::thread::id cancelThread;
+	};
+
+	bool CancellationToken::IsCancelled() const
 	{
-		stopRecieving = true;
-		recieverThread.join();
+		if (!state)
+			return false;
+		std::lock_guard<std::mutex> lock(state->mutex);
+		return state->cancelled;
 	}
-
-	void WebSocketAsyncGameConnection::_Register(String nickname)
+	bool CancellationToken::CanBeCancelled() const
 	{
-		Send(COMMAND_REGISTER, nickname);
-		state = State::Searching;
+		return static_cast<bool>(state);
 	}
 
-
-	std::vector<Player> WebSocketAsyncGameConnection::_GetPlayers()
+	uint64_t CancellationToken::Subscribe(std::function<void()> callback) const
 	{
-		listUpdated = false;
-		Send(COMMAND_LIST);
+		if (!state)
+			return 0;
 
-		// might be a problem because listUpdated is accessed in another thread
-		while (!listUpdated)
+		std::unique_lock<std::mutex> lock(state->mutex);
+		if (state->cancelled)
 		{
-			using namespace std::chrono_literals;
-			std::this_thread::sleep_for(10ms);
+			lock.unlock();
+			callback();
+			return 0;
 		}
-		
-		auto players = SplitBy(listResponse, '\n');
+		uint64_t subscription = state->nextSubscription++;
+		state->callbacks.emplace(subscription, std::move(callback));
+		return subscription;
+	}
+	void CancellationToken::Unsubscribe(uint64_t subscription) const
+	{
+		if (!state || subscription == 0)
+			return;
 
-		std::vector<Player> res;
-		for (auto& s : players)
-		{
-			auto colon = s.find(':');
-			PlayerID playerID = s.substr(0, colon);
-			String playerNickname = s.substr(colon + 1);
+		std::unique_lock<std::mutex> lock(state->mutex);
+		if (state->callbacks.erase(subscription) != 0)
+			return;
 
-			if (playerID != id)
-				res.emplace_back(playerID, playerNickname);
-		}
-		return res;
+		// a callback that unsubscribes itself must not wait for itself
+		if (state->running == subscription && state->cancelThread != std::this_thread::get_id())
+			state->callbackFinished.wait(lock, [&]() { return state->running != subscription; });
 	}
 
-	void WebSocketAsyncGameConnection::_SendOffer(PlayerID sendTo)
+	CancellationSource::CancellationSource() : state(std::make_shared<CancellationToken::State>())
 	{
-		Send(COMMAND_OFFER, sendTo);
 	}
-	std::vector<PlayerID> WebSocketAsyncGameConnection::_GetOffers()
+	CancellationToken CancellationSource::GetToken() const
 	{
-		return offers;
+		CancellationToken token;
+		token.state = state;
+		return token;
 	}
-
-	std::vector<Message> WebSocketAsyncGameConnection::_GetMessages()
+	bool CancellationSource::IsCancelled() const
 	{
-		std::vector<Message> res;
-		res.reserve(unparsedMessages.size());
-
-		dataMutex.lock();
-		for (auto& p : unparsedMessages)
-			res.push_back(p.second);
-		dataMutex.unlock();
-
-		return res;
+		std::lock_guard<std::mutex> lock(state->mutex);
+		return state->cancelled;
 	}
-	void WebSocketAsyncGameConnection::_RemoveMessage(MessageID id)
+	void CancellationSource::Cancel()
 	{
-		std::lock_guard<std::mutex> lock(dataMutex);
-		if (unparsedMessages.count(id) == 0)
-			throw UnknownMessageIdException("Unknown message id: " + std::to_string(id));
+		std::unique_lock<std::mutex> lock(state->mutex);
+		if (state->cancelled)
+			return;
+		state->cancelled = true;
+		state->cancelThread = std::this_thread::get_id();
 
-#ifdef _DEBUG
-		parsedMessages.insert(unparsedMessages.find(id)->second);
-#endif
-		unparsedMessages.erase(id);
-	}
+		// the callbacks run without the lock, so they may unsubscribe others and themselves
+		while (!state->callbacks.empty())
+		{
+			auto callback = state->callbacks.extract(state->callbacks.begin());
+			state->running = callback.key();
+			lock.unlock();
+
+			callback.mapped()();
+
+			lock.lock();
+			state->running = 0;
+			state->callbackFinished.notify_all();
+		}
+	}
+
+	ResolverCache& ResolverCache::Global()
+	{
+		static ResolverCache cache;
+		return cache;
+	}
+
+	void ResolverCache::SetTimeToLive(std::chrono::seconds ttl)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		timeToLive = ttl;
+		if (ttl.count() == 0)
+			entries.clear();
+	}
+	void ResolverCache::Invalidate(std::string const& host, std::string const& port)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.erase(host + ':' + port);
+	}
+	void ResolverCache::Clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+	}
+
+	void ResolverCache::AsyncResolve(net::any_io_executor executor, std::string const& host, std::string const& port, ResolveHandler handler)
+	{
+		std::string key = host + ':' + port;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			auto entry = entries.find(key);
+			if (entry != entries.end())
+			{
+				if (entry->second.expires > std::chrono::steady_clock::now())
+				{
+					auto results = entry->second.results;
+					lock.unlock();
+					handler({}, std::move(results));
+					return;
+				}
+				entries.erase(entry);
+			}
+
+			// only the first request resolves, the rest wait for its result
+			auto [waiting, first] = pending.try_emplace(key);
+			waiting->second.push_back(std::move(handler));
+			if (!first)
+				return;
+		}
+
+		// the resolver belongs to the lookup, so a closed connection does not cancel it for the others waiting
+		auto resolver = std::make_shared<tcp::resolver>(executor);
+		resolver->async_resolve(host, port, [this, resolver, key](beast::error_code const& ec, tcp::resolver::results_type results) {
+			std::vector<ResolveHandler> handlers;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto waiting = pending.find(key);
+				handlers = std::move(waiting->second);
+				pending.erase(waiting);
+
+				if (!ec && timeToLive.count() != 0)
+					entries[key] = Entry{ results, std::chrono::steady_clock::now() + timeToLive };
+			}
+			for (auto& handler : handlers)
+				handler(ec, results);
+		});
+	}
+
+#ifdef CONNECTION_TLS
+	// asio keeps its verify callbacks in the app data, so the context and the session key use their own indices
+	static int TlsContextIndex()
+	{
+		static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+		return index;
+	}
+	static int SessionKeyIndex()
+	{
+		static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+		return index;
+	}
+
+	TlsContext::TlsContext(TlsOptions const& options) :
+		ssl(net::ssl::context::tls_client), verifyPeer(options.verifyPeer), sessionResumption(options.sessionResumption)
+	{
+		ssl.set_options(net::ssl::context::default_workarounds | net::ssl::context::no_sslv2 | net::ssl::context::no_sslv3 |
+			net::ssl::context::no_tlsv1 | net::ssl::context::no_tlsv1_1);
+
+		SSL_CTX* handle = ssl.native_handle();
+		if (!options.cipherList.empty() && SSL_CTX_set_cipher_list(handle, options.cipherList.c_str()) != 1)
+			throw ConnectionException("No usable TLS ciphers in \"" + options.cipherList + "\"");
+		if (!options.cipherSuites.empty() && SSL_CTX_set_ciphersuites(handle, options.cipherSuites.c_str()) != 1)
+			throw ConnectionException("No usable TLS 1.3 cipher suites in \"" + options.cipherSuites + "\"");
+
+		try
+		{
+			if (options.verifyPeer)
+			{
+				if (options.caFile.empty())
+					ssl.set_default_verify_paths();
+				else
+					ssl.load_verify_file(options.caFile);
+				ssl.set_verify_mode(net::ssl::verify_peer);
+			}
+			else
+			{
+				ssl.set_verify_mode(net::ssl::verify_none);
+			}
+		}
+		catch (std::exception const& e)
+		{
+			throw ConnectionException("Failed to load the TLS certificates: " + std::string(e.what()));
+		}
+
+		if (sessionResumption)
+		{
+			// the sessions are kept here per server, the internal cache of OpenSSL is for servers only
+			SSL_CTX_set_ex_data(handle, TlsContextIndex(), this);
+			SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+			SSL_CTX_sess_set_new_cb(handle, &TlsContext::NewSessionCallback);
+		}
+		else
+		{
+			SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_OFF);
+			SSL_CTX_set_options(handle, SSL_OP_NO_TICKET);
+		}
+	}
+
+	int TlsContext::NewSessionCallback(SSL* ssl, SSL_SESSION* session)
+	{
+		auto self = static_cast<TlsContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), TlsContextIndex()));
+		auto key = static_cast<std::string const*>(SSL_get_ex_data(ssl, SessionKeyIndex()));
+		if (!self || !key)
+			return 0;
+
+		// OpenSSL marks the session of a connection closed without close_notify as not resumable, so a copy is kept
+		SSL_SESSION* copy = SSL_SESSION_dup(session);
+		if (!copy)
+			return 0;
+
+		// a TLS 1.3 server may send several tickets, the latest one replaces the rest
+		std::shared_ptr<SSL_SESSION> saved(copy, SSL_SESSION_free);
+		std::lock_guard<std::mutex> lock(self->sessionMutex);
+		self->sessions[*key] = std::move(saved);
+		// the original session stays with OpenSSL
+		return 0;
+	}
+
+	net::ssl::context& TlsContext::GetSslContext()
+	{
+		return ssl;
+	}
+	bool TlsContext::IsPeerVerified() const
+	{
+		return verifyPeer;
+	}
+
+	void TlsContext::AttachSession(SSL* ssl, std::string const& key)
+	{
+		if (!sessionResumption)
+			return;
+
+		SSL_set_ex_data(ssl, SessionKeyIndex(), const_cast<std::string*>(&key));
+
+		std::shared_ptr<SSL_SESSION> session;
+		{
+			std::lock_guard<std::mutex> lock(sessionMutex);
+			auto it = sessions.find(key);
+			if (it == sessions.end())
+				return;
+			if (!SSL_SESSION_is_resumable(it->second.get()))
+			{
+				sessions.erase(it);
+				return;
+			}
+			session = it->second;
+		}
+		// SSL_set_session takes its own reference, an expired session only leads to a full handshake
+		SSL_set_session(ssl, session.get());
+	}
+
+	size_t TlsContext::GetSessionCount()
+	{
+		std::lock_guard<std::mutex> lock(sessionMutex);
+		return sessions.size();
+	}
+	void TlsContext::ClearSessions()
+	{
+		std::lock_guard<std::mutex> lock(sessionMutex);
+		sessions.clear();
+	}
+#endif
+
+
+	void WebSocketAsyncGameConnection::HandlePlayerId(std::string_view playerId)
+	{
+		std::lock_guard<std::mutex> lock(dataMutex);
+		id = PlayerID(playerId);
+	}
+	void WebSocketAsyncGameConnection::HandlePlayers(PlayersSnapshot players)
+	{
+		std::lock_guard<std::mutex> lock(dataMutex);
+
+		// the list is parsed once and shared by everyone who waits for it
+		playersSnapshot.store(players);
+		playersTime = std::chrono::steady_clock::now();
+		++playersGeneration;
+
+		auto handlers = std::move(listHandlers);
+		listHandlers.clear();
+		listRequested = false;
+		for (auto& handler : handlers)
+			handler(nullptr, players);
+	}
+	// every peak has a single writer, so a load and a store are enough
+	static void RaisePeak(std::atomic<size_t>& peak, size_t value)
+	{
+		if (value > peak.load(std::memory_order_relaxed))
+			peak.store(value, std::memory_order_relaxed);
+	}
+
+	void WebSocketAsyncGameConnection::HandleOffer(std::string_view from)
+	{
+		std::lock_guard<std::mutex> lock(dataMutex);
+
+		// a repeated offer neither grows the list nor notifies again
+		PlayerID player(from);
+		if (std::find(offers.begin(), offers.end(), player) != offers.end())
+		{
+			duplicateOffers.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		InboxOptions const& limits = options.inbox;
+		if (limits.maxOffers != 0 && offers.size() >= limits.maxOffers)
+		{
+			if (!offersFull)
+			{
+				offersFull = true;
+				NotifyHighWaterMark(LimitedList::Offers, offers.size());
+			}
+			droppedOffers.fetch_add(1, std::memory_order_relaxed);
+			if (limits.offerPolicy == OverflowPolicy::DropNewest)
+				return;
+			offers.erase(offers.begin());
+		}
+
+		offers.push_back(player);
+		storedOffers.store(offers.size(), std::memory_order_relaxed);
+		RaisePeak(storedOffersPeak, offers.size());
+		NotifyOffer(offers.back());
+	}
+	void WebSocketAsyncGameConnection::ClearOffers()
+	{
+		offers.clear();
+		offersFull = false;
+		storedOffers.store(0, std::memory_order_relaxed);
+	}
+	void WebSocketAsyncGameConnection::HandleGameStarted(std::string_view opponent)
+	{
+		std::lock_guard<std::mutex> lock(dataMutex);
+		opponentID = PlayerID(opponent);
+		state = State::InGame;
+
+		inbox.Push({ true, opponentID, 0, std::pmr::string() });
+
+		ClearOffers();
+
+		NotifyGameStarted(opponentID);
+	}
+	void WebSocketAsyncGameConnection::HandleGameEnded()
+	{
+		std::lock_guard<std::mutex> lock(dataMutex);
+		inbox.Push({ true, PlayerID(), 0, std::pmr::string() });
+
+		ClearOffers();
+
+		opponentID = PlayerID();
+
+		state = State::Searching;
+
+		NotifyGameEnded();
+	}
+	void WebSocketAsyncGameConnection::HandleChatMessage(std::string_view text)
+	{
+		// the message path does not take dataMutex, opponentID is changed only by this thread
+		MessageID messageID = GetMessageID();
+		if (HasMessageCallback())
+			NotifyMessage(Message(opponentID, messageID, String(text)));
+
+		if (!ReserveMessage())
+			return;
+
+		// the text is copied straight into the pool, the sender is known to the consumer from the last reset
+		inbox.Push({ false, PlayerID(), messageID, std::pmr::string(text, &messagePool) });
+		inboxDepth.fetch_add(1, std::memory_order_relaxed);
+		RaisePeak(storedMessagesPeak, storedMessages.fetch_add(1, std::memory_order_relaxed) + 1);
+	}
+	bool WebSocketAsyncGameConnection::ReserveMessage()
+	{
+		InboxOptions const& limits = options.inbox;
+		// with PauseReading the rest of the frame is still accepted, the limit is exceeded at most by one batch
+		if (limits.maxMessages == 0 || limits.messagePolicy == OverflowPolicy::PauseReading)
+			return true;
+		if (storedMessages.load(std::memory_order_relaxed) < limits.maxMessages)
+		{
+			messagesFull = false;
+			return true;
+		}
+
+		// the count includes the messages of a finished game until its reset is drained, so it is drained here
+		std::lock_guard<std::mutex> lock(inboxMutex);
+		DrainInbox();
+		if (storedMessages.load(std::memory_order_relaxed) < limits.maxMessages)
+		{
+			messagesFull = false;
+			return true;
+		}
+
+		if (!messagesFull)
+		{
+			messagesFull = true;
+			NotifyHighWaterMark(LimitedList::Messages, storedMessages.load(std::memory_order_relaxed));
+		}
+		droppedMessages.fetch_add(1, std::memory_order_relaxed);
+		if (limits.messagePolicy == OverflowPolicy::DropNewest)
+			return false;
+
+		// this strand is the only producer, so after the drain every message is in the map, and its first key is the oldest
+		unparsedMessages.erase(unparsedMessages.begin());
+		storedMessages.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	bool WebSocketAsyncGameConnection::PauseReadingIfFull()
+	{
+		InboxOptions const& limits = options.inbox;
+		if (limits.maxMessages == 0 || limits.messagePolicy != OverflowPolicy::PauseReading)
+			return false;
+		if (storedMessages.load(std::memory_order_relaxed) < limits.maxMessages)
+		{
+			messagesFull = false;
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(inboxMutex);
+		DrainInbox();
+		if (storedMessages.load(std::memory_order_relaxed) < limits.maxMessages)
+		{
+			messagesFull = false;
+			return false;
+		}
+
+		// the reader resumes under the same lock, so the wakeup cannot be missed
+		readPaused = true;
+		readPauses.fetch_add(1, std::memory_order_relaxed);
+		if (!messagesFull)
+		{
+			messagesFull = true;
+			NotifyHighWaterMark(LimitedList::Messages, storedMessages.load(std::memory_order_relaxed));
+		}
+		return true;
+	}
+	void WebSocketAsyncGameConnection::ResumeReadingIfDrained()
+	{
+		if (!readPaused)
+			return;
+
+		InboxOptions const& limits = options.inbox;
+		size_t resume = limits.resumeMessages != 0 ? limits.resumeMessages : limits.maxMessages / 2;
+		if (storedMessages.load(std::memory_order_relaxed) > resume)
+			return;
+
+		readPaused = false;
+		net::post(strand, [this]() {
+			// a reconnect starts reading by itself
+			if (closing || reading || link != LinkState::Up)
+				return;
+			ReadNext();
+		});
+	}
+	void WebSocketAsyncGameConnection::HandleResponse(MessageID messageID, String response)
+	{
+		PendingRequest request;
+		if (!ExtractRequest(messageID, request))
+			return;
+		if (histograms)
+			histograms->commands[static_cast<size_t>(request.command) - 1].Record(std::chrono::steady_clock::now() - request.sent);
+
+		// the handler is called without the lock, so it may send new requests
+		request.handler(nullptr, std::move(response));
+	}
+
+	void WebSocketAsyncGameConnection::ParseServerMessage(std::string_view message)
+	{
+		if (StartsWith(message, NEW_MESSAGE))
+		{
+			HandleChatMessage(message.substr(NEW_MESSAGE.size()));
+		}
+		else if (StartsWith(message, PLAYER_ID))
+		{
+			HandlePlayerId(message.substr(PLAYER_ID.size()));
+		}
+		else if (StartsWith(message, LIST))
+		{
+			HandlePlayers(ParsePlayers(message.substr(LIST.size())));
+		}
+		else if (StartsWith(message, NEW_OFFER))
+		{
+			HandleOffer(message.substr(NEW_OFFER.size()));
+		}
+		else if (StartsWith(message, IN_GAME_WITH))
+		{
+			HandleGameStarted(message.substr(IN_GAME_WITH.size()));
+		}
+		else if (StartsWith(message, END_GAME))
+		{
+			HandleGameEnded();
+		}
+		else
+		{
+			throw UnhandledServerMessageException("Unrecognised server message: " + std::string(message));
+		}
+	}
+	void WebSocketAsyncGameConnection::ParseResponse(std::string_view id, std::string_view message)
+	{
+		MessageID messageID;
+		auto [end, ec] = std::from_chars(id.data(), id.data() + id.size(), messageID);
+		if (ec != std::errc() || end != id.data() + id.size())
+			throw UnhandledServerMessageException("Unrecognised response id: " + std::string(id));
+
+		HandleResponse(messageID, String(message));
+	}
+	void WebSocketAsyncGameConnection::ParseMessage(std::string_view message)
+	{
+		auto at = message.find('@');
+		if (at == std::string_view::npos)
+			throw UnhandledServerMessageException("Unrecognised message: " + std::string(message));
+
+		std::string_view id = message.substr(0, at);
+		message.remove_prefix(at + 1);
+
+		if (id == "server")
+		{
+			ParseServerMessage(message);
+		}
+		else
+		{
+			ParseResponse(id, message);
+		}
+	}
+	void WebSocketAsyncGameConnection::ParseBinaryMessage(std::string_view message)
+	{
+		wire::FrameReader reader(message);
+
+		uint8_t opcode;
+		if (!reader.ReadByte(opcode))
+			throw UnhandledServerMessageException("Empty binary frame");
+
+		std::string_view field;
+		switch (static_cast<wire::Opcode>(opcode))
+		{
+		case wire::Opcode::Response:
+		{
+			uint64_t messageID;
+			uint8_t status;
+			if (!reader.ReadVarint(messageID) || !reader.ReadByte(status))
+				throw UnhandledServerMessageException("Malformed binary response");
+
+			if (static_cast<wire::Status>(status) == wire::Status::Success)
+			{
+				HandleResponse(static_cast<MessageID>(messageID), SUCCESS);
+			}
+			else
+			{
+				// errors are passed on in the text form, so CheckResponse works for both protocols
+				if (!reader.ReadString(field))
+					throw UnhandledServerMessageException("Malformed binary response");
+				HandleResponse(static_cast<MessageID>(messageID), ERROR + String(field));
+			}
+			return;
+		}
+		case wire::Opcode::NewMessage:
+			if (!reader.ReadString(field))
+				break;
+			HandleChatMessage(field);
+			return;
+		case wire::Opcode::PlayerId:
+			if (!reader.ReadString(field))
+				break;
+			HandlePlayerId(field);
+			return;
+		case wire::Opcode::PlayerList:
+			HandlePlayers(ParseBinaryPlayers(reader));
+			return;
+		case wire::Opcode::NewOffer:
+			if (!reader.ReadString(field))
+				break;
+			HandleOffer(field);
+			return;
+		case wire::Opcode::GameStarted:
+			if (!reader.ReadString(field))
+				break;
+			HandleGameStarted(field);
+			return;
+		case wire::Opcode::GameEnded:
+			HandleGameEnded();
+			return;
+		default:
+			throw UnhandledServerMessageException("Unrecognised binary opcode: " + std::to_string(opcode));
+		}
+		throw UnhandledServerMessageException("Malformed binary frame, opcode: " + std::to_string(opcode));
+	}
+
+	void WebSocketAsyncGameConnection::MessageHandler(
+		beast::error_code const& ec,		// Result of operation
+		std::size_t /*bytes_written*/		// Number of bytes appended to buffer, the frame is the whole buffer
+	)
+	{
+		OperationFinished();
+		reading = false;
+		if (closing)
+			return;
+		if (ec)
+		{
+			LinkFailed(ec.message());
+			return;
+		}
+
+		// flat_buffer is contiguous, so the frame is parsed in place and copied only where it is stored
+		auto data = buffer.cdata();
+		std::string_view frame(static_cast<const char*>(data.data()), data.size());
+		CaptureFrame(CaptureDirection::Inbound, frame);
+
+		HandleFrame(frame);
+		buffer.consume(buffer.size());
+
+		// the socket is left unread until the reader removes messages, tcp flow control then slows the server down
+		if (PauseReadingIfFull())
+			return;
+		ReadNext();
+	}
+	void WebSocketAsyncGameConnection::HandleFrame(std::string_view frame)
+	{
+		framesIn.fetch_add(1, std::memory_order_relaxed);
+		bytesIn.fetch_add(frame.size(), std::memory_order_relaxed);
+
+		auto start = std::chrono::steady_clock::now();
+		try
+		{
+			if (binaryProtocol)
+				ParseBinaryMessage(frame);
+			else
+				ParseMessage(frame);
+		}
+		// the context threads are shared with other connections, so a bad frame is skipped instead of escaping from run()
+		catch (UnhandledServerMessageException const&)
+		{
+			unhandledServerMessages.fetch_add(1, std::memory_order_relaxed);
+		}
+		catch (std::exception const&)
+		{
+			parseErrors.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (histograms)
+			histograms->frameHandling.Record(std::chrono::steady_clock::now() - start);
+	}
+	void WebSocketAsyncGameConnection::CaptureFrame(CaptureDirection direction, std::string_view frame)
+	{
+		if (!capture)
+			return;
+		try
+		{
+			capture->Append(direction, frame);
+		}
+		catch (CaptureException const&)
+		{
+			// the handlers run on the context threads, so a file that cannot grow stops the capture instead of the connection
+			capture->Stop();
+		}
+	}
+	void WebSocketAsyncGameConnection::ReadNext()
+	{
+		++activeOperations;
+		reading = true;
+		std::visit([this](auto& stream) {
+			stream.async_read(
+				buffer,
+				[this](beast::error_code const& ec, std::size_t bytes_written) {
+					this->MessageHandler(ec, bytes_written);
+				});
+		}, ws);
+	}
+
+	void WebSocketAsyncGameConnection::OperationFinished()
+	{
+		--activeOperations;
+		if (closing && activeOperations == 0)
+			closed.set_value();
+	}
+
+	// msg_size_threshold appeared in later Boost versions, on older ones every message is compressed
+	template <typename Deflate>
+	static void SetCompressionThreshold(Deflate& deflate, size_t minMessageSize)
+	{
+		if constexpr (requires { deflate.msg_size_threshold; })
+			deflate.msg_size_threshold = minMessageSize;
+	}
+
+	static websocket::permessage_deflate MakeDeflateOptions(CompressionOptions const& compression)
+	{
+		// zlib does not work with 8 bit windows
+		if (compression.windowBits < 9 || compression.windowBits > 15)
+			throw ConnectionException("Compression window bits must be between 9 and 15");
+		if (compression.level < 0 || compression.level > 9)
+			throw ConnectionException("Compression level must be between 0 and 9");
+
+		websocket::permessage_deflate deflate;
+		deflate.client_enable = compression.enabled;
+		deflate.client_max_window_bits = compression.windowBits;
+		deflate.server_max_window_bits = compression.windowBits;
+		deflate.client_no_context_takeover = compression.noContextTakeover;
+		deflate.server_no_context_takeover = compression.noContextTakeover;
+		deflate.compLevel = compression.level;
+		SetCompressionThreshold(deflate, compression.minMessageSize);
+		return deflate;
+	}
+
+	WebSocketAsyncGameConnection::Stream WebSocketAsyncGameConnection::MakeStream(net::strand<net::io_context::executor_type> const& strand,
+		ConnectionOptions const& options)
+	{
+#ifdef CONNECTION_TLS
+		if (options.tls)
+			return Stream(std::in_place_index<1>, strand, options.tls->GetSslContext());
+#endif
+		return Stream(std::in_place_index<0>, strand);
+	}
+
+#ifdef CONNECTION_TLS
+	net::awaitable<void> WebSocketAsyncGameConnection::TlsHandshake(beast::ssl_stream<tcp::socket>& stream)
+	{
+		SSL* ssl = stream.native_handle();
+
+		// SNI lets the server pick the certificate, it must not contain an ip address
+		beast::error_code ec;
+		net::ip::make_address(url, ec);
+		if (ec && !SSL_set_tlsext_host_name(ssl, url.c_str()))
+			throw ConnectionException("Failed to set the TLS server name");
+
+		if (options.tls->IsPeerVerified())
+			stream.set_verify_callback(net::ssl::host_name_verification(url));
+
+		tlsSessionKey = url + ':' + port;
+		options.tls->AttachSession(ssl, tlsSessionKey);
+
+		try
+		{
+			co_await stream.async_handshake(net::ssl::stream_base::client, net::use_awaitable);
+		}
+		catch (std::exception const& e)
+		{
+			std::string s = e.what();
+			throw ConnectionException("TLS handshake failed: " + s);
+		}
+		tlsSessionReused = SSL_session_reused(ssl) != 0;
+	}
+#endif
+
+	/*
+	*     :      attemptDelay     
+	*       target,   
+	*    strand 
+	*/
+	class WebSocketAsyncGameConnection::EndpointRace : public std::enable_shared_from_this<EndpointRace>
+	{
+		tcp::socket& target;
+		std::vector<tcp::endpoint> endpoints;
+		//   ,      
+		std::vector<tcp::socket> sockets;
+		net::steady_timer timer;
+		const std::chrono::milliseconds attemptDelay;
+		std::function<void(beast::error_code ec)> handler;
+
+		size_t active = 0;
+		bool finished = false;
+		beast::error_code lastError = net::error::host_not_found;
+
+		void StartNext()
+		{
+			size_t index = sockets.size();
+			sockets.emplace_back(timer.get_executor());
+			++active;
+			sockets[index].async_connect(endpoints[index], [self = shared_from_this(), index](beast::error_code const& ec) {
+				self->Connected(index, ec);
+			});
+
+			if (sockets.size() == endpoints.size())
+				return;
+			timer.expires_after(attemptDelay);
+			timer.async_wait([self = shared_from_this(), index](beast::error_code const& ec) {
+				if (!ec && !self->finished && self->sockets.size() == index + 1)
+					self->StartNext();
+			});
+		}
+		void Connected(size_t index, beast::error_code const& ec)
+		{
+			--active;
+			if (finished)
+				return;
+
+			if (!ec)
+			{
+				Finish(ec, index);
+				return;
+			}
+
+			lastError = ec;
+			if (sockets.size() < endpoints.size())
+			{
+				// a refused attempt does not wait for the delay
+				timer.cancel();
+				StartNext();
+			}
+			else if (active == 0)
+				Finish(lastError, endpoints.size());
+		}
+		void Finish(beast::error_code const& ec, size_t winner)
+		{
+			finished = true;
+			timer.cancel();
+			for (size_t i = 0; i < sockets.size(); i++)
+			{
+				beast::error_code ignored;
+				if (i != winner)
+					sockets[i].close(ignored);
+			}
+			if (winner < sockets.size())
+				target = std::move(sockets[winner]);
+			handler(ec);
+		}
+	public:
+		EndpointRace(tcp::socket& target, tcp::resolver::results_type const& results, std::chrono::milliseconds attemptDelay,
+			std::function<void(beast::error_code ec)> handler) :
+			target(target), endpoints(results.begin(), results.end()), timer(target.get_executor()), attemptDelay(attemptDelay), handler(std::move(handler))
+		{
+			sockets.reserve(endpoints.size());
+		}
+
+		void Start()
+		{
+			if (endpoints.empty())
+				Finish(lastError, 0);
+			else
+				StartNext();
+		}
+		void Cancel()
+		{
+			if (!finished)
+				Finish(net::error::operation_aborted, endpoints.size());
+		}
+	};
+
+	net::awaitable<void> WebSocketAsyncGameConnection::ConnectEndpoints(tcp::socket& socket)
+	{
+		co_await net::async_initiate<decltype(net::use_awaitable), void(beast::error_code)>(
+			[this, &socket](auto handler) {
+				race = std::make_shared<EndpointRace>(socket, results, options.connectAttemptDelay,
+					BindToExecutor<beast::error_code>(std::move(handler)));
+				race->Start();
+			}, net::use_awaitable);
+		race.reset();
+	}
+
+	net::awaitable<tcp::resolver::results_type> WebSocketAsyncGameConnection::Resolve()
+	{
+		try
+		{
+			co_return co_await net::async_initiate<decltype(net::use_awaitable), void(beast::error_code, tcp::resolver::results_type)>(
+				[this](auto handler) {
+					ResolverCache::Global().AsyncResolve(context->GetIoContext().get_executor(), url, port,
+						BindToExecutor<beast::error_code, tcp::resolver::results_type>(std::move(handler)));
+				}, net::use_awaitable);
+		}
+		catch (std::exception const& e)
+		{
+			std::string s = e.what();
+			throw ConnectionException("Failed to resolve the server address: " + s);
+		}
+	}
+
+	template <typename WebSocket>
+	net::awaitable<void> WebSocketAsyncGameConnection::HandshakeStream(WebSocket& stream)
+	{
+		try
+		{
+			// Make the connection on the IP address we get from a lookup
+			co_await ConnectEndpoints(beast::get_lowest_layer(stream));
+		}
+		catch (std::exception const& e)
+		{
+			std::string s = e.what();
+			throw ConnectionException("Failed to connect to the server: " + s);
+		}
+
+		// pipelined requests are already queued by the write queue, so Nagle's algorithm only delays them
+		beast::get_lowest_layer(stream).set_option(tcp::no_delay(true));
+
+#ifdef CONNECTION_TLS
+		if constexpr (std::is_same_v<WebSocket, TlsStream>)
+			co_await TlsHandshake(stream.next_layer());
+#endif
+
+		if (options.compression.enabled)
+			stream.set_option(MakeDeflateOptions(options.compression));
+
+		// Set a decorator to change the User-Agent of the handshake
+		stream.set_option(websocket::stream_base::decorator(
+			[this](websocket::request_type& req)
+			{
+				req.set(http::field::user_agent,
+					std::string(BOOST_BEAST_VERSION_STRING) +
+					" websocket-client-coro");
+
+				if (options.preferBinaryProtocol)
+					req.set(http::field::sec_websocket_protocol, std::string(wire::BINARY_SUBPROTOCOL));
+			}));
+
+		// Perform the websocket handshake
+		websocket::response_type response;
+		co_await stream.async_handshake(response, url, "/", net::use_awaitable);
+
+		// a server that does not know the binary protocol does not echo it and the text protocol is used
+		auto subprotocol = response[http::field::sec_websocket_protocol];
+		binaryProtocol = options.preferBinaryProtocol &&
+			std::string_view(subprotocol.data(), subprotocol.size()) == wire::BINARY_SUBPROTOCOL;
+		stream.binary(binaryProtocol);
+	}
+
+	net::awaitable<void> WebSocketAsyncGameConnection::Handshake()
+	{
+		results = co_await Resolve();
+		if (closing)
+			throw ConnectionException("connection is closed");
+
+		auto start = std::chrono::steady_clock::now();
+		co_await std::visit([this](auto& stream) { return HandshakeStream(stream); }, ws);
+		connectTime = std::chrono::steady_clock::now() - start;
+	}
+
+	void WebSocketAsyncGameConnection::ResetStream()
+	{
+		buffer.clear();
+#ifdef CONNECTION_TLS
+		if (options.tls)
+		{
+			ws.emplace<1>(strand, options.tls->GetSslContext());
+			return;
+		}
+#endif
+		ws.emplace<0>(strand);
+	}
+
+	net::awaitable<void> WebSocketAsyncGameConnection::Start()
+	{
+		state = State::NotConnected;
+		if (options.inbox.offerPolicy == OverflowPolicy::PauseReading)
+			throw ConnectionException("Offers cannot pause reading, they are removed only when a game starts or ends");
+		if (options.reconnect.enabled && options.reconnect.registerTimeout.count() <= 0)
+			throw ConnectionException("Reconnect register timeout must be positive");
+		try
+		{
+			co_await Handshake();
+
+			// the protocol is known only after the handshake, the reader needs it to parse the capture
+			if (!options.capture.path.empty())
+				capture = std::make_unique<FrameCaptureWriter>(options.capture.path, binaryProtocol, options.capture.maxSize);
+		}
+		catch (std::exception const& e)
+		{
+			throw ConnectionException(e.what());
+		}
+
+		started = true;
+		ReadNext();
+		state = State::Registration;
+	}
+
+	void WebSocketAsyncGameConnection::Connect()
+	{
+		// the handshake runs in the strand like every other operation with ws, the caller only waits for it
+		net::co_spawn(strand, Start(), net::use_future).get();
+	}
+
+	void WebSocketAsyncGameConnection::StartConnect(std::shared_ptr<ConnectionContext> context, std::string url, std::string port, ConnectionOptions options,
+		ConnectHandler handler)
+	{
+		// the constructor is private, so make_unique cannot be used
+		std::unique_ptr<WebSocketAsyncGameConnection> connection(
+			new WebSocketAsyncGameConnection(DeferredTag(), std::move(context), std::move(url), std::move(port), std::move(options)));
+
+		WebSocketAsyncGameConnection& starting = *connection;
+		net::co_spawn(starting.strand, starting.Start(), [connection = std::move(connection), handler](std::exception_ptr error) mutable {
+			// a connection that has not started has nothing to wait for, so it is destroyed right here in the context thread
+			if (error)
+				connection.reset();
+			handler(error, std::move(connection));
+		});
+	}
+
+	MessageID WebSocketAsyncGameConnection::GetMessageID()
+	{
+		return nextMessageID.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void WebSocketAsyncGameConnection::Write(OutgoingFrame frame)
+	{
+		net::post(strand, [this, frame = std::move(frame)]() mutable {
+			if (closing)
+			{
+				FailRequest(frame.messageId, "connection is closed");
+				return;
+			}
+			if (link == LinkState::Lost)
+			{
+				FailRequest(frame.messageId, "connection is lost");
+				return;
+			}
+
+			// while the connection is restored the requests wait in the queue
+			writeQueue.push_back(std::move(frame));
+			if (writing || link != LinkState::Up)
+				return;
+
+			CoalescingOptions const& coalescing = options.coalescing;
+			// the text protocol sends every request in its own frame, so waiting for more requests gains nothing there
+			if (binaryProtocol && coalescing.enabled && coalescing.flushDelay.count() > 0 && writeQueue.size() < coalescing.maxBatchSize)
+			{
+				// wait for more requests, the first one is not delayed more than flushDelay
+				if (!flushScheduled)
+				{
+					flushScheduled = true;
+					++activeOperations;
+					flushTimer.expires_after(coalescing.flushDelay);
+					// a cancelled timer also flushes, the handler skips the queue a full batch is already writing
+					flushTimer.async_wait([this](beast::error_code const&) {
+						this->FlushHandler();
+					});
+				}
+				return;
+			}
+
+			// a full batch does not wait for the timer, the timer handler finds the writing already started
+			if (flushScheduled)
+				flushTimer.cancel();
+			WriteNext();
+		});
+	}
+	void WebSocketAsyncGameConnection::FlushHandler()
+	{
+		OperationFinished();
+		flushScheduled = false;
+		if (closing)
+		{
+			FailQueuedFrames("connection is closed");
+			return;
+		}
+
+		if (!writing && !writeQueue.empty() && link == LinkState::Up)
+			WriteNext();
+	}
+	void WebSocketAsyncGameConnection::WriteNext()
+	{
+		writing = true;
+		++activeOperations;
+
+		auto handler = [this](beast::error_code const& ec, std::size_t bytes_transferred) {
+			this->WriteHandler(ec, bytes_transferred);
+		};
+
+		CoalescingOptions const& coalescing = options.coalescing;
+		if (binaryProtocol && coalescing.enabled && writeQueue.size() > 1 && coalescing.maxBatchSize > 1)
+		{
+			// all queued requests go out in one frame and one write
+			framesInFlight = std::min<size_t>(writeQueue.size(), coalescing.maxBatchSize);
+
+			batchFrame.clear();
+			wire::FrameWriter writer(batchFrame);
+			writer.WriteByte(static_cast<uint8_t>(wire::Opcode::Batch));
+			writer.WriteVarint(framesInFlight);
+			for (size_t i = 0; i < framesInFlight; i++)
+				writer.WriteString(writeQueue[i].data);
+
+			CaptureFrame(CaptureDirection::Outbound, batchFrame);
+			std::visit([&](auto& stream) { stream.async_write(net::buffer(batchFrame), std::move(handler)); }, ws);
+			return;
+		}
+
+		framesInFlight = 1;
+		CaptureFrame(CaptureDirection::Outbound, writeQueue.front().data);
+		std::visit([&](auto& stream) { stream.async_write(net::buffer(writeQueue.front().data), std::move(handler)); }, ws);
+	}
+	void WebSocketAsyncGameConnection::WriteHandler(beast::error_code const& ec, std::size_t bytes_transferred)
+	{
+		OperationFinished();
+		writing = false;
+		if (ec)
+		{
+			if (closing || !options.reconnect.enabled)
+			{
+				// the connection is broken, none of the queued requests will be answered
+				FailQueuedFrames(ec.message());
+				if (!closing)
+					LinkFailed(ec.message());
+				return;
+			}
+
+			// the written requests may have reached the server, so they are not repeated on the new connection
+			for (size_t i = 0; i < framesInFlight; i++)
+				FailRequest(writeQueue[i].messageId, ec.message());
+			writeQueue.erase(writeQueue.begin(), writeQueue.begin() + framesInFlight);
+			framesInFlight = 0;
+			LinkFailed(ec.message());
+			return;
+		}
+
+		framesOut.fetch_add(1, std::memory_order_relaxed);
+		bytesOut.fetch_add(bytes_transferred, std::memory_order_relaxed);
+
+		// LinkLost has left these frames to the write, no reply to them will come over the lost connection
+		if (link == LinkState::Lost)
+		{
+			for (size_t i = 0; i < framesInFlight; i++)
+				FailRequest(writeQueue[i].messageId, closing ? "connection is closed" : "connection is lost");
+		}
+		writeQueue.erase(writeQueue.begin(), writeQueue.begin() + framesInFlight);
+		framesInFlight = 0;
+		if (link != LinkState::Up)
+		{
+			// the read has found the connection broken while this write was in flight
+			TryReconnect();
+			return;
+		}
+		if (!writeQueue.empty())
+			WriteNext();
+	}
+	void WebSocketAsyncGameConnection::FailQueuedFrames(std::string const& reason)
+	{
+		// the frames of the write in flight hold its buffer until WriteHandler, which fails and erases them
+		size_t kept = writing ? framesInFlight : 0;
+		std::deque<OutgoingFrame> failed(std::make_move_iterator(writeQueue.begin() + kept), std::make_move_iterator(writeQueue.end()));
+		writeQueue.erase(writeQueue.begin() + kept, writeQueue.end());
+		framesInFlight = kept;
+
+		std::exception_ptr error = std::make_exception_ptr(ConnectionException(reason));
+		for (auto& frame : failed)
+			FailRequest(frame.messageId, error);
+	}
+
+	void WebSocketAsyncGameConnection::FailRequest(MessageID messageID, std::exception_ptr error)
+	{
+		PendingRequest request;
+		if (!ExtractRequest(messageID, request))
+			return;
+		request.handler(error, String());
+	}
+	void WebSocketAsyncGameConnection::FailRequest(MessageID messageID, std::string const& reason)
+	{
+		FailRequest(messageID, std::make_exception_ptr(ConnectionException(reason)));
+	}
+
+	void WebSocketAsyncGameConnection::AddRequest(MessageID messageID, PendingRequest request, CallOptions const& call)
+	{
+		std::chrono::milliseconds timeout = call.timeout.count() != 0 ? call.timeout : options.requestTimeout;
+		if (timeout.count() > 0)
+			request.deadline = request.sent + timeout;
+
+		// the callback may come before the request is stored, so the token is checked once more afterwards
+		if (call.cancellation.CanBeCancelled())
+		{
+			request.cancellation = call.cancellation;
+			request.subscription = call.cancellation.Subscribe([this, messageID]() {
+				FailRequest(messageID, std::make_exception_ptr(CancelledException(REQUEST_CANCELLED)));
+			});
+		}
+
+		auto deadline = request.deadline;
+		uint64_t subscription = request.subscription;
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			if (!responses.Insert(messageID, std::move(request)))
+			{
+				call.cancellation.Unsubscribe(subscription);
+				throw ConnectionException("Too many requests are waiting for a reply");
+			}
+
+			if (deadline != std::chrono::steady_clock::time_point::max())
+			{
+				deadlines.emplace(deadline, messageID);
+				// with one timeout for all requests a new deadline is later than the armed one and the timer is not touched
+				if (deadline < armedDeadline)
+				{
+					armedDeadline = deadline;
+					net::post(strand, [this, deadline]() { ArmDeadlineTimer(deadline); });
+				}
+			}
+		}
+
+		if (call.cancellation.IsCancelled())
+			FailRequest(messageID, std::make_exception_ptr(CancelledException(REQUEST_CANCELLED)));
+	}
+
+	bool WebSocketAsyncGameConnection::ExtractRequest(MessageID messageID, PendingRequest& request)
+	{
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			if (!responses.Extract(messageID, request))
+				return false;
+			if (request.deadline != std::chrono::steady_clock::time_point::max())
+				deadlines.erase({ request.deadline, messageID });
+		}
+		// outside the lock, because a running cancel callback takes it
+		request.cancellation.Unsubscribe(request.subscription);
+		return true;
+	}
+
+	void WebSocketAsyncGameConnection::ArmDeadlineTimer(std::chrono::steady_clock::time_point deadline)
+	{
+		if (closing)
+			return;
+
+		// the previous wait is aborted and only the latest one handles the deadlines
+		++activeOperations;
+		deadlineTimer.expires_at(deadline);
+		deadlineTimer.async_wait([this](beast::error_code const& ec) {
+			this->DeadlineHandler(ec);
+		});
+	}
+	void WebSocketAsyncGameConnection::DeadlineHandler(beast::error_code const& ec)
+	{
+		OperationFinished();
+		if (ec || closing)
+			return;
+
+		auto now = std::chrono::steady_clock::now();
+		std::vector<PendingRequest> expired;
+		auto next = std::chrono::steady_clock::time_point::max();
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			while (!deadlines.empty() && deadlines.begin()->first <= now)
+			{
+				MessageID messageID = deadlines.begin()->second;
+				deadlines.erase(deadlines.begin());
+
+				PendingRequest request;
+				if (responses.Extract(messageID, request))
+					expired.push_back(std::move(request));
+			}
+
+			// a request added after this point sees the new armed deadline and arms the timer itself if it is earlier
+			if (!deadlines.empty())
+				next = deadlines.begin()->first;
+			armedDeadline = next;
+		}
+		if (next != std::chrono::steady_clock::time_point::max())
+			ArmDeadlineTimer(next);
+
+		// the frame may still be sent, its late reply finds no request and is dropped
+		std::exception_ptr error = std::make_exception_ptr(TimeoutException(REQUEST_TIMED_OUT));
+		for (auto& request : expired)
+		{
+			request.cancellation.Unsubscribe(request.subscription);
+			request.handler(error, String());
+		}
+	}
+
+	void WebSocketAsyncGameConnection::FailSentRequests(std::string const& reason)
+	{
+		// the queued requests have not been written yet and are sent again after reconnecting
+		std::unordered_set<MessageID> queued;
+		for (auto& frame : writeQueue)
+			queued.insert(frame.messageId);
+
+		std::vector<PendingRequest> failed;
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			failed = responses.ExtractIf([&queued](MessageID messageID) { return queued.count(messageID) == 0; });
+		}
+		// their deadlines stay in the set and are skipped when they come
+		std::exception_ptr error = std::make_exception_ptr(ConnectionException(reason));
+		for (auto& request : failed)
+		{
+			request.cancellation.Unsubscribe(request.subscription);
+			request.handler(error, String());
+		}
+	}
+	void WebSocketAsyncGameConnection::FailListHandlers(std::string const& reason)
+	{
+		decltype(listHandlers) handlers;
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			handlers = std::move(listHandlers);
+			listHandlers.clear();
+			listRequested = false;
+		}
+
+		auto error = std::make_exception_ptr(ConnectionException(reason));
+		for (auto& handler : handlers)
+			handler(error, nullptr);
+	}
+
+	void WebSocketAsyncGameConnection::LinkFailed(std::string const& reason)
+	{
+		if (link == LinkState::Up)
+		{
+			// the read or the write in the other direction fails on its own once the socket is closed
+			std::visit([](auto& stream) {
+				beast::error_code ec;
+				beast::get_lowest_layer(stream).close(ec);
+			}, ws);
+
+			if (!options.reconnect.enabled)
+			{
+				LinkLost(reason);
+				return;
+			}
+
+			link = LinkState::Down;
+			// a failed attempt does not change the state to restore
+			if (!recovering)
+			{
+				recovering = true;
+				restoreState = state;
+				downSince = std::chrono::steady_clock::now();
+			}
+			FailSentRequests(reason);
+			FailListHandlers(reason);
+		}
+		TryReconnect();
+	}
+
+	void WebSocketAsyncGameConnection::LinkLost(std::string const& reason)
+	{
+		link = LinkState::Lost;
+		recovering = false;
+		state = State::NotConnected;
+
+		FailQueuedFrames(reason);
+		FailSentRequests(reason);
+		FailListHandlers(reason);
+	}
+
+	void WebSocketAsyncGameConnection::TryReconnect()
+	{
+		// the stream is replaced, so its read and write must be finished
+		if (link != LinkState::Down || reading || writing || reconnecting || closing)
+			return;
+
+		if (options.reconnect.maxAttempts != 0 && reconnectAttempts >= options.reconnect.maxAttempts)
+		{
+			LinkLost("failed to reconnect to the server");
+			return;
+		}
+
+		reconnecting = true;
+		++activeOperations;
+		net::co_spawn(strand, Reconnect(), net::bind_executor(strand, [this](std::exception_ptr) {
+			reconnecting = false;
+			if (closing)
+			{
+				OperationFinished();
+				return;
+			}
+			OperationFinished();
+			TryReconnect();
+		}));
+	}
+
+	std::chrono::milliseconds WebSocketAsyncGameConnection::ReconnectDelay()
+	{
+		ReconnectOptions const& reconnect = options.reconnect;
+
+		// pow overflows to infinity on long outages, which the limit handles as well
+		double delay = reconnect.initialDelay.count() * std::pow(reconnect.multiplier, static_cast<double>(reconnectAttempts));
+		delay = (std::min)(delay, static_cast<double>(reconnect.maxDelay.count()));
+
+		std::uniform_real_distribution<double> jitter(1 - std::clamp(reconnect.jitter, 0.0, 1.0), 1);
+		return std::chrono::milliseconds(static_cast<int64_t>(delay * jitter(random)));
+	}
+
+	net::awaitable<void> WebSocketAsyncGameConnection::Reconnect()
+	{
+		reconnectTimer.expires_after(ReconnectDelay());
+		++reconnectAttempts;
+
+		beast::error_code ec;
+		co_await reconnectTimer.async_wait(net::redirect_error(net::use_awaitable, ec));
+		if (closing)
+			co_return;
+
+		bool wasBinary = binaryProtocol;
+		try
+		{
+			ResetStream();
+			co_await Handshake();
+		}
+		catch (std::exception const&)
+		{
+			// the server may have moved, the next attempt resolves its name again and waits longer
+			ResolverCache::Global().Invalidate(url, port);
+			co_return;
+		}
+		if (closing)
+			co_return;
+
+		// the queued frames are encoded for the previous protocol
+		if (binaryProtocol != wasBinary)
+			FailQueuedFrames("the server has changed the protocol");
+
+		link = LinkState::Up;
+		ReadNext();
+
+		String name;
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			name = nickname;
+		}
+		if (restoreState == State::Registration || name.empty())
+		{
+			if (!writing && !writeQueue.empty())
+				WriteNext();
+		}
+		else
+		{
+			try
+			{
+				co_await Reregister();
+			}
+			catch (std::exception const& e)
+			{
+				// the server may still hold the old session with this name, the next attempt gives it time to notice the drop
+				if (!closing)
+					LinkFailed(e.what());
+				co_return;
+			}
+			if (closing)
+				co_return;
+
+			// the server has ended the game when the old connection dropped
+			if (restoreState == State::InGame)
+				HandleGameEnded();
+			else
+				state = State::Searching;
+		}
+
+		recovering = false;
+		reconnectAttempts = 0;
+		reconnects.fetch_add(1, std::memory_order_relaxed);
+		if (histograms)
+			histograms->reconnectTime.Record(std::chrono::steady_clock::now() - downSince);
+	}
+
+	net::awaitable<void> WebSocketAsyncGameConnection::Reregister()
+	{
+		co_await net::async_initiate<decltype(net::use_awaitable), void(std::exception_ptr)>(
+			[this](auto handler) {
+				auto done = BindToExecutor<std::exception_ptr>(std::move(handler));
+				MessageID messageID = nextRequestID.fetch_add(1, std::memory_order_relaxed);
+
+				String name;
+				{
+					std::lock_guard<std::mutex> lock(dataMutex);
+					name = nickname;
+				}
+
+				PendingRequest request;
+				request.handler = [done](std::exception_ptr error, String response) {
+					if (error)
+					{
+						done(error);
+						return;
+					}
+					try
+					{
+						CheckResponse(response);
+					}
+					catch (...)
+					{
+						done(std::current_exception());
+						return;
+					}
+					done(nullptr);
+				};
+				request.sent = std::chrono::steady_clock::now();
+
+				// the registration has its own deadline, so a lost reply makes the next attempt instead of stalling the recovery
+				CallOptions call;
+				call.timeout = options.reconnect.registerTimeout;
+				try
+				{
+					AddRequest(messageID, std::move(request), call);
+				}
+				catch (...)
+				{
+					done(std::current_exception());
+					return;
+				}
+
+				// the requests queued during the outage are sent after the registration
+				writeQueue.push_front({ messageID, EncodeRequest(messageID, wire::Opcode::Register, name) });
+				if (!writing)
+					WriteNext();
+			}, net::use_awaitable);
+	}
+
+	void WebSocketAsyncGameConnection::Registered(String name)
+	{
+		std::lock_guard<std::mutex> lock(dataMutex);
+		nickname = std::move(name);
+		state = State::Searching;
+	}
+
+	// Text form of the command and whether it takes an argument
+	static std::pair<String const&, bool> TextCommand(wire::Opcode command)
+	{
+		switch (command)
+		{
+		case wire::Opcode::Register:
+			return { COMMAND_REGISTER, true };
+		case wire::Opcode::List:
+			return { COMMAND_LIST, false };
+		case wire::Opcode::Offer:
+			return { COMMAND_OFFER, true };
+		case wire::Opcode::Message:
+			return { COMMAND_MESSAGE, true };
+		case wire::Opcode::EndGame:
+			return { COMMAND_END_GAME, false };
+		default:
+			throw ConnectionException("Unknown command: " + std::to_string(static_cast<int>(command)));
+		}
+	}
+
+	std::string WebSocketAsyncGameConnection::EncodeRequest(MessageID messageID, wire::Opcode command, std::string_view data)
+	{
+		std::string frame;
+		if (binaryProtocol)
+		{
+			frame.reserve(1 + 5 + 5 + data.size());
+
+			wire::FrameWriter writer(frame);
+			writer.WriteByte(static_cast<uint8_t>(command));
+			writer.WriteVarint(static_cast<uint32_t>(messageID));
+			if (!data.empty() || TextCommand(command).second)
+				writer.WriteString(data);
+			return frame;
+		}
+
+		auto [name, hasArgument] = TextCommand(command);
+		frame = std::to_string(messageID);
+		frame += '@';
+		frame += name;
+		if (hasArgument)
+		{
+			frame += ':';
+			frame += data;
+		}
+		return frame;
+	}
+
+	void WebSocketAsyncGameConnection::SendAsync(wire::Opcode command, String data, CallOptions const& call, ResponseHandler handler)
+	{
+		if (call.cancellation.IsCancelled())
+			throw CancelledException(REQUEST_CANCELLED);
+
+		MessageID messageID = nextRequestID.fetch_add(1, std::memory_order_relaxed);
+
+		std::string message = EncodeRequest(messageID, command, data);
+
+		// the handler is registered before writing, because the reply may come right after the write
+		PendingRequest request;
+		request.handler = std::move(handler);
+		request.command = command;
+		request.sent = std::chrono::steady_clock::now();
+		AddRequest(messageID, std::move(request), call);
+
+		Write({ messageID, std::move(message) });
+	}
+	std::future<String> WebSocketAsyncGameConnection::SendAsync(wire::Opcode command, String data, CallOptions const& call)
+	{
+		auto promise = std::make_shared<std::promise<String>>();
+		std::future<String> future = promise->get_future();
+
+		SendAsync(command, std::move(data), call, [promise](std::exception_ptr error, String response) {
+			if (error)
+				promise->set_exception(error);
+			else
+				promise->set_value(std::move(response));
+		});
+		return future;
+	}
+
+	void WebSocketAsyncGameConnection::SendCheckedAsync(wire::Opcode command, String data, CallOptions const& call,
+		std::function<void(std::exception_ptr error)> handler)
+	{
+		try
+		{
+			SendAsync(command, std::move(data), call, [handler](std::exception_ptr error, String response) {
+				if (error)
+				{
+					handler(error);
+					return;
+				}
+				try
+				{
+					CheckResponse(response);
+				}
+				catch (...)
+				{
+					handler(std::current_exception());
+					return;
+				}
+				handler(nullptr);
+			});
+		}
+		catch (...)
+		{
+			handler(std::current_exception());
+		}
+	}
+
+	std::function<void(std::exception_ptr error, PlayersSnapshot players)> WebSocketAsyncGameConnection::GuardListHandler(CallOptions const& call,
+		std::function<void(std::exception_ptr error, PlayersSnapshot players)> handler)
+	{
+		// the guard does not refer to the connection, so it may outlive it in the timer or the token
+		struct Guard
+		{
+			std::mutex mutex;
+			std::function<void(std::exception_ptr error, PlayersSnapshot players)> handler;
+			std::optional<net::steady_timer> timer;
+			CancellationToken cancellation;
+			uint64_t subscription = 0;
+
+			void Complete(std::exception_ptr error, PlayersSnapshot players)
+			{
+				decltype(handler) completed;
+				uint64_t subscribed = 0;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					completed = std::move(handler);
+					handler = nullptr;
+					subscribed = subscription;
+					if (timer)
+						timer->cancel();
+				}
+				if (!completed)
+					return;
+				cancellation.Unsubscribe(subscribed);
+				completed(error, std::move(players));
+			}
+		};
+		auto guard = std::make_shared<Guard>();
+		guard->handler = std::move(handler);
+		guard->cancellation = call.cancellation;
+
+		if (call.timeout.count() > 0)
+		{
+			guard->timer.emplace(strand, call.timeout);
+			guard->timer->async_wait([guard](beast::error_code const& ec) {
+				if (!ec)
+					guard->Complete(std::make_exception_ptr(TimeoutException(REQUEST_TIMED_OUT)), nullptr);
+			});
+		}
+		if (call.cancellation.CanBeCancelled())
+		{
+			// a token that is already cancelled calls back right inside Subscribe, so the lock is not held here
+			uint64_t subscription = call.cancellation.Subscribe([guard]() {
+				guard->Complete(std::make_exception_ptr(CancelledException(REQUEST_CANCELLED)), nullptr);
+			});
+
+			std::unique_lock<std::mutex> lock(guard->mutex);
+			if (guard->handler)
+				guard->subscription = subscription;
+			else
+			{
+				lock.unlock();
+				call.cancellation.Unsubscribe(subscription);
+			}
+		}
+		return [guard](std::exception_ptr error, PlayersSnapshot players) {
+			guard->Complete(error, std::move(players));
+		};
+	}
+
+	void WebSocketAsyncGameConnection::RequestListAsync(CallOptions const& call, std::function<void(std::exception_ptr error, PlayersSnapshot players)> handler)
+	{
+		if (call.timeout.count() > 0 || call.cancellation.CanBeCancelled())
+			handler = GuardListHandler(call, std::move(handler));
+
+		uint64_t generation;
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			listHandlers.push_back(std::move(handler));
+			if (listRequested)
+				return;
+			listRequested = true;
+			generation = playersGeneration.load();
+		}
+
+		// on success the handlers are called when the list comes
+		SendCheckedAsync(wire::Opcode::List, String(), CallOptions(), [this, generation](std::exception_ptr error) {
+			if (!error)
+				return;
+
+			decltype(listHandlers) handlers;
+			{
+				std::lock_guard<std::mutex> lock(dataMutex);
+				// the list came without the reply, the handlers wait for a later request
+				if (playersGeneration.load() != generation)
+					return;
+				handlers = std::move(listHandlers);
+				listHandlers.clear();
+				listRequested = false;
+			}
+			for (auto& handler : handlers)
+				handler(error, nullptr);
+		});
+	}
+
+	struct WebSocketAsyncGameConnection::OutgoingBatch
+	{
+		std::vector<String> messages;
+		std::vector<std::exception_ptr> results;
+		std::function<void(std::vector<std::exception_ptr> results)> handler;
+		CallOptions call;
+
+		std::mutex mutex;
+		size_t next = 0;
+		size_t inFlight = 0;
+		size_t remaining = 0;
+		// only one thread sends, a reply that comes meanwhile is picked up by its loop
+		bool sending = false;
+	};
+
+	void WebSocketAsyncGameConnection::SendBatchAsync(std::vector<String> messages, CallOptions const& call,
+		std::function<void(std::vector<std::exception_ptr> results)> handler)
+	{
+		if (messages.empty())
+		{
+			handler({});
+			return;
+		}
+
+		auto batch = std::make_shared<OutgoingBatch>();
+		batch->results.resize(messages.size());
+		batch->remaining = messages.size();
+		batch->messages = std::move(messages);
+		batch->handler = std::move(handler);
+		batch->call = call;
+		SendBatchNext(std::move(batch));
+	}
+	void WebSocketAsyncGameConnection::SendBatchNext(std::shared_ptr<OutgoingBatch> batch)
+	{
+		std::unique_lock<std::mutex> lock(batch->mutex);
+		if (batch->sending)
+			return;
+		batch->sending = true;
+
+		// the whole window is queued at once, so the write queue can pack it together
+		while (batch->next < batch->messages.size() && batch->inFlight < MAX_BATCH_IN_FLIGHT)
+		{
+			size_t i = batch->next++;
+			++batch->inFlight;
+			lock.unlock();
+
+			// a request that fails right away calls the handler here, the loop then sends the next one without recursion
+			SendCheckedAsync(wire::Opcode::Message, std::move(batch->messages[i]), batch->call, [this, batch, i](std::exception_ptr error) {
+				bool last;
+				{
+					std::lock_guard<std::mutex> lock(batch->mutex);
+					batch->results[i] = error;
+					--batch->inFlight;
+					last = --batch->remaining == 0;
+				}
+				if (last)
+					batch->handler(std::move(batch->results));
+				else
+					SendBatchNext(batch);
+			});
+
+			lock.lock();
+		}
+		batch->sending = false;
+	}
+
+	PlayersSnapshot WebSocketAsyncGameConnection::GetCachedPlayers()
+	{
+		// the list is refreshed only while searching, after a game it is older than the interval until the next refresh
+		std::chrono::milliseconds interval = playersRefreshInterval.load();
+		if (interval <= std::chrono::milliseconds(0) || state != State::Searching)
+			return nullptr;
+		if (std::chrono::steady_clock::now() - playersTime.load() > interval)
+			return nullptr;
+		return playersSnapshot.load();
+	}
+
+	void WebSocketAsyncGameConnection::ScheduleRefresh()
+	{
+		++activeOperations;
+		refreshTimer.expires_after(playersRefreshInterval.load());
+		refreshTimer.async_wait([this](beast::error_code const& ec) {
+			this->RefreshHandler(ec);
+		});
+	}
+	void WebSocketAsyncGameConnection::RefreshHandler(beast::error_code const& ec)
+	{
+		OperationFinished();
+		// operation_aborted means the interval was changed and a new wait is already started
+		if (ec || closing)
+			return;
+		// the timer may expire just before the refresh is turned off, cancel does not reach a handler that is already queued
+		if (playersRefreshInterval.load() <= std::chrono::milliseconds(0))
+			return;
+
+		if (state == State::Searching && link == LinkState::Up)
+			RequestListAsync(CallOptions(), [](std::exception_ptr, PlayersSnapshot) {});
+		ScheduleRefresh();
+	}
+
+	void WebSocketAsyncGameConnection::CheckResponse(String const& response)
+	{
+		if (StartsWith(response, ERROR))
+			throw ConnectionException(response.substr(ERROR.size()));
+	}
+
+	void WebSocketAsyncGameConnection::Send(wire::Opcode command, String data, CallOptions const& call)
+	{
+		CheckResponse(SendAsync(command, std::move(data), call).get());
+	}
+
+	WebSocketAsyncGameConnection::WebSocketAsyncGameConnection() : WebSocketAsyncGameConnection(DEFAULT_URL, DEFAULT_PORT)
+	{
+	}
+	WebSocketAsyncGameConnection::WebSocketAsyncGameConnection(std::string url, std::string port) : WebSocketAsyncGameConnection(std::make_shared<ConnectionContext>(1), url, port)
+	{
+	}
+	WebSocketAsyncGameConnection::WebSocketAsyncGameConnection(std::shared_ptr<ConnectionContext> context, std::string url, std::string port, ConnectionOptions options) :
+		WebSocketAsyncGameConnection(DeferredTag(), std::move(context), std::move(url), std::move(port), std::move(options))
+	{
+		Connect();
+	}
+	WebSocketAsyncGameConnection::WebSocketAsyncGameConnection(DeferredTag, std::shared_ptr<ConnectionContext> context, std::string url, std::string port,
+		ConnectionOptions options) :
+		url(url), port(port), context(context), strand(net::make_strand(context->GetIoContext())), ws(MakeStream(strand, options)),
+		options(options), flushTimer(strand), deadlineTimer(strand), refreshTimer(strand), reconnectTimer(strand), random(std::random_device()())
+	{
+		if (options.latencyHistograms)
+			histograms = std::make_unique<LatencyHistograms>();
+
+		SetEventExecutor(strand);
+	}
+	WebSocketAsyncGameConnection::WebSocketAsyncGameConnection(OfflineTag, std::shared_ptr<ConnectionContext> context, bool binaryProtocol) :
+		context(context), strand(net::make_strand(context->GetIoContext())), ws(std::in_place_index<0>, strand),
+		binaryProtocol(binaryProtocol), flushTimer(strand), deadlineTimer(strand), refreshTimer(strand), offline(true), reconnectTimer(strand)
+	{
+		// the replay measures the handling time of every frame
+		histograms = std::make_unique<LatencyHistograms>();
+
+		SetEventExecutor(strand);
+		state = State::Registration;
+	}
+	std::unique_ptr<WebSocketAsyncGameConnection> WebSocketAsyncGameConnection::CreateOffline(std::shared_ptr<ConnectionContext> context, bool binaryProtocol)
+	{
+		// the constructor is private, so make_unique cannot be used
+		return std::unique_ptr<WebSocketAsyncGameConnection>(new WebSocketAsyncGameConnection(OfflineTag(), std::move(context), binaryProtocol));
+	}
+	WebSocketAsyncGameConnection::~WebSocketAsyncGameConnection()
+	{
+		// the failed connect has finished every operation, AsyncConnect destroys such a connection in a context thread
+		if (!started && !offline)
+			return;
+
+		// Closing the socket cancels the pending read and writes, the connection is destroyed after their handlers finish
+		auto done = closed.get_future();
+		net::post(strand, [this]() {
+			closing = true;
+
+			refreshTimer.cancel();
+			flushTimer.cancel();
+			reconnectTimer.cancel();
+			deadlineTimer.cancel();
+			if (race)
+				race->Cancel();
+
+			std::visit([](auto& stream) {
+				beast::error_code ec;
+				beast::get_lowest_layer(stream).close(ec);
+			}, ws);
+
+			// no reply will come, a reconnect waiting for the registration finishes as well
+			LinkLost("connection is closed");
+
+			if (activeOperations == 0)
+				closed.set_value();
+		});
+		done.wait();
+
+		// the handler that has finished the last operation may still be running, the strand runs this after it returns
+		std::promise<void> idle;
+		net::post(strand, [&idle]() { idle.set_value(); });
+		idle.get_future().wait();
+	}
+
+	PlayerID WebSocketAsyncGameConnection::_GetID()
+	{
+		// the id is assigned by the reading thread, copying it changes the reference count of the entry
+		std::lock_guard<std::mutex> lock(dataMutex);
+		return id;
+	}
+
+	void WebSocketAsyncGameConnection::_Register(String nickname, CallOptions const& call)
+	{
+		Send(wire::Opcode::Register, nickname, call);
+		Registered(std::move(nickname));
+	}
+
+
+	std::vector<Player> WebSocketAsyncGameConnection::_GetPlayers(CallOptions const& call)
+	{
+		if (PlayersSnapshot players = GetCachedPlayers())
+			return *players;
+
+		auto promise = std::make_shared<std::promise<PlayersSnapshot>>();
+		auto future = promise->get_future();
+		RequestListAsync(call, [promise](std::exception_ptr error, PlayersSnapshot players) {
+			if (error)
+				promise->set_exception(error);
+			else
+				promise->set_value(std::move(players));
+		});
+		return *future.get();
+	}
+
+	PlayersSnapshot WebSocketAsyncGameConnection::ParsePlayers(std::string_view list)
+	{
+		auto players = SplitBy(list, '\n');
+
+		auto res = std::make_shared<std::vector<Player>>();
+		res->reserve(players.size());
+		for (auto& s : players)
+		{
+			auto colon = s.find(':');
+			std::string_view playerID = s.substr(0, colon);
+			std::string_view playerNickname = s.substr(colon + 1);
+
+			PlayerID player(playerID);
+			if (player != id)
+				res->emplace_back(player, String(playerNickname));
+		}
+		return res;
+	}
+
+	PlayersSnapshot WebSocketAsyncGameConnection::ParseBinaryPlayers(wire::FrameReader& reader)
+	{
+		uint64_t count;
+		if (!reader.ReadVarint(count))
+			throw UnhandledServerMessageException("Malformed binary player list");
+
+		auto res = std::make_shared<std::vector<Player>>();
+		// the count comes from the network, so it only limits the reservation
+		res->reserve(static_cast<size_t>(std::min<uint64_t>(count, 4096)));
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			std::string_view playerID, playerNickname;
+			if (!reader.ReadString(playerID) || !reader.ReadString(playerNickname))
+				throw UnhandledServerMessageException("Malformed binary player list");
+
+			PlayerID player(playerID);
+			if (player != id)
+				res->emplace_back(player, String(playerNickname));
+		}
+		return res;
+	}
+
+	PlayersSnapshot WebSocketAsyncGameConnection::GetPlayersSnapshot()
+	{
+		return playersSnapshot.load();
+	}
+	uint64_t WebSocketAsyncGameConnection::GetPlayersGeneration()
+	{
+		return playersGeneration.load();
+	}
+
+	void WebSocketAsyncGameConnection::ReplayFrame(std::string_view frame)
+	{
+		if (!offline)
+			throw StateException("Wrong state: frames can be replayed only by an offline connection");
+
+		HandleFrame(frame);
+	}
+
+	bool WebSocketAsyncGameConnection::IsBinaryProtocol() const
+	{
+		return binaryProtocol;
+	}
+	bool WebSocketAsyncGameConnection::IsConnected() const
+	{
+		return link == LinkState::Up;
+	}
+
+	ConnectionStats WebSocketAsyncGameConnection::GetStats() const
+	{
+		ConnectionStats stats;
+		stats.framesIn = framesIn.load(std::memory_order_relaxed);
+		stats.framesOut = framesOut.load(std::memory_order_relaxed);
+		stats.bytesIn = bytesIn.load(std::memory_order_relaxed);
+		stats.bytesOut = bytesOut.load(std::memory_order_relaxed);
+		stats.inboxDepth = inboxDepth.load(std::memory_order_relaxed);
+		stats.storedMessages = storedMessages.load(std::memory_order_relaxed);
+		stats.storedMessagesPeak = storedMessagesPeak.load(std::memory_order_relaxed);
+		stats.storedOffers = storedOffers.load(std::memory_order_relaxed);
+		stats.storedOffersPeak = storedOffersPeak.load(std::memory_order_relaxed);
+		stats.droppedMessages = droppedMessages.load(std::memory_order_relaxed);
+		stats.droppedOffers = droppedOffers.load(std::memory_order_relaxed);
+		stats.duplicateOffers = duplicateOffers.load(std::memory_order_relaxed);
+		stats.readPauses = readPauses.load(std::memory_order_relaxed);
+		stats.unhandledServerMessages = unhandledServerMessages.load(std::memory_order_relaxed);
+		stats.parseErrors = parseErrors.load(std::memory_order_relaxed);
+
+		if (histograms)
+		{
+			for (size_t i = 0; i < COMMAND_COUNT; i++)
+				stats.commandLatency[TextCommand(static_cast<wire::Opcode>(i + 1)).first] = histograms->commands[i].GetSnapshot();
+			stats.frameHandling = histograms->frameHandling.GetSnapshot();
+			stats.reconnectTime = histograms->reconnectTime.GetSnapshot();
+		}
+		stats.connectTime = connectTime.load();
+		stats.tlsSessionReused = tlsSessionReused.load();
+		stats.reconnects = reconnects.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void WebSocketAsyncGameConnection::SetPlayersRefreshInterval(std::chrono::milliseconds interval)
+	{
+		net::post(strand, [this, interval]() {
+			if (closing)
+				return;
+
+			playersRefreshInterval = interval;
+			refreshTimer.cancel();
+			if (interval > std::chrono::milliseconds(0))
+				ScheduleRefresh();
+		});
+	}
+
+	void WebSocketAsyncGameConnection::_SendOffer(PlayerID sendTo, CallOptions const& call)
+	{
+		Send(wire::Opcode::Offer, sendTo.ToString(), call);
+	}
+	std::vector<PlayerID> WebSocketAsyncGameConnection::_GetOffers()
+	{
+		std::lock_guard<std::mutex> lock(dataMutex);
+		return offers;
+	}
+
+	void WebSocketAsyncGameConnection::DrainInbox()
+	{
+		while (std::optional<InboxEntry> entry = inbox.TryPop())
+		{
+			if (!entry->reset)
+			{
+				inboxDepth.fetch_sub(1, std::memory_order_relaxed);
+				unparsedMessages.emplace(entry->messageId, UnparsedText{ std::move(entry->text) });
+			}
+			else
+			{
+#ifdef _DEBUG
+				parsedMessages.clear();
+#endif
+				// the memory of all messages goes back to the pool
+				storedMessages.fetch_sub(unparsedMessages.size(), std::memory_order_relaxed);
+				unparsedMessages.clear();
+				inboxOpponent = std::move(entry->opponent);
+			}
+		}
+	}
+
+	std::vector<Message> WebSocketAsyncGameConnection::_GetMessages()
+	{
+		std::lock_guard<std::mutex> lock(inboxMutex);
+		DrainInbox();
+		ResumeReadingIfDrained();
+
+		std::vector<Message> res;
+		res.reserve(unparsedMessages.size());
+		for (auto& p : unparsedMessages)
+			res.emplace_back(inboxOpponent, p.first, String(p.second.text));
+
+		return res;
+	}
+	void WebSocketAsyncGameConnection::_RemoveMessage(MessageID id)
+	{
+		std::lock_guard<std::mutex> lock(inboxMutex);
+		DrainInbox();
+
+		auto it = unparsedMessages.find(id);
+		if (it == unparsedMessages.end())
+			throw UnknownMessageIdException("Unknown message id: " + std::to_string(id));
+
+#ifdef _DEBUG
+		parsedMessages.insert(Message(inboxOpponent, it->first, String(it->second.text)));
+#endif
+		unparsedMessages.erase(it);
+		storedMessages.fetch_sub(1, std::memory_order_relaxed);
+		ResumeReadingIfDrained();
+	}
 
 #ifdef _DEBUG
 	std::vector<Message> WebSocketAsyncGameConnection::_GetParsedMessages()
 	{
-		std::lock_guard<std::mutex> lock(dataMutex);
+		std::lock_guard<std::mutex> lock(inboxMutex);
+		DrainInbox();
 		return std::vector<Message>(parsedMessages.begin(), parsedMessages.end());
 	}
 
@@ -498,14 +2764,60 @@ namespace conn
 	}
 #endif
 
-	void WebSocketAsyncGameConnection::_SendMessage(String message)
+	void WebSocketAsyncGameConnection::_SendMessage(String message, CallOptions const& call)
+	{
+		Send(wire::Opcode::Message, message, call);
+	}
+
+	std::vector<std::exception_ptr> WebSocketAsyncGameConnection::_SendMessages(std::vector<String> messages, CallOptions const& call)
+	{
+		auto promise = std::make_shared<std::promise<std::vector<std::exception_ptr>>>();
+		auto future = promise->get_future();
+		SendBatchAsync(std::move(messages), call, [promise](std::vector<std::exception_ptr> results) {
+			promise->set_value(std::move(results));
+		});
+		return future.get();
+	}
+
+	void WebSocketAsyncGameConnection::_EndGame(CallOptions const& call)
+	{
+		Send(wire::Opcode::EndGame, String(), call);
+		state = State::Searching;
+	}
+
+	net::awaitable<void> WebSocketAsyncGameConnection::_RegisterAsync(String nickname, CallOptions call)
+	{
+		co_await AsyncSend(wire::Opcode::Register, nickname, call, net::use_awaitable);
+		Registered(std::move(nickname));
+	}
+
+	net::awaitable<std::vector<Player>> WebSocketAsyncGameConnection::_GetPlayersAsync(CallOptions call)
+	{
+		if (PlayersSnapshot players = GetCachedPlayers())
+			co_return *players;
+
+		PlayersSnapshot players = co_await AsyncRequestList(call, net::use_awaitable);
+		co_return *players;
+	}
+
+	net::awaitable<void> WebSocketAsyncGameConnection::_SendOfferAsync(PlayerID sendTo, CallOptions call)
+	{
+		co_await AsyncSend(wire::Opcode::Offer, sendTo.ToString(), call, net::use_awaitable);
+	}
+
+	net::awaitable<void> WebSocketAsyncGameConnection::_SendMessageAsync(String message, CallOptions call)
+	{
+		co_await AsyncSend(wire::Opcode::Message, message, call, net::use_awaitable);
+	}
+
+	net::awaitable<std::vector<std::exception_ptr>> WebSocketAsyncGameConnection::_SendMessagesAsync(std::vector<String> messages, CallOptions call)
 	{
-		Send(COMMAND_MESSAGE, message);
+		co_return co_await AsyncSendBatch(std::move(messages), call, net::use_awaitable);
 	}
 
-	void WebSocketAsyncGameConnection::_EndGame()
+	net::awaitable<void> WebSocketAsyncGameConnection::_EndGameAsync(CallOptions call)
 	{
-		Send(COMMAND_END_GAME);
+		co_await AsyncSend(wire::Opcode::EndGame, String(), call, net::use_awaitable);
 		state = State::Searching;
 	}
 
@@ -2,7 +2,12 @@
 
 #include <exception>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <span>
+#include <cstdint>
+#include <compare>
+#include <iosfwd>
 
 //     
 #pragma warning(push, 0)
@@ -12,12 +17,45 @@
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_future.hpp>
+//  wss ,     OpenSSL   CONNECTION_TLS
+#ifdef CONNECTION_TLS
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/ssl.hpp>
+#endif
 #pragma warning(pop)
 
 #include <unordered_map>
+#include <map>
+#include <deque>
 #include <set>
 #include <thread>
 #include <mutex>
+#include <functional>
+#include <future>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <chrono>
+#include <array>
+#include <memory_resource>
+#include <variant>
+#include <random>
+
+#include "MpscQueue.hpp"
+#include "RecyclingPool.hpp"
+#include "PendingRequests.hpp"
+#include "WireProtocol.hpp"
+#include "LatencyHistogram.hpp"
 
 #undef SendMessage
 
@@ -69,6 +107,19 @@ namespace conn
 		UnknownMessageIdException(const std::string& msg) : ConnectionException(msg) {}
 	};
 
+	//        
+	class TimeoutException : public ConnectionException
+	{
+	public:
+		TimeoutException(const std::string& msg) : ConnectionException(msg) {}
+	};
+	//    CancellationSource
+	class CancelledException : public ConnectionException
+	{
+	public:
+		CancelledException(const std::string& msg) : ConnectionException(msg) {}
+	};
+
 	/*
 	*  ,     
 	*     
@@ -77,9 +128,81 @@ namespace conn
 
 	/*
 	*   
-	*     
+	*    ID     ,     -    ,
+	*       
+	*        PlayerID,    ,   32-     ID
+	*      ,   
+	*  PlayerID   
 	*/
-	typedef String PlayerID;
+	class PlayerID
+	{
+		//  ID     PlayerID,    
+		struct Entry
+		{
+			String id;
+			uint32_t handle = 0;
+			std::atomic<uint32_t> references{ 0 };
+		};
+		Entry* entry = nullptr;
+
+		//        
+		void RemoveEntry();
+
+		friend struct PlayerIDTable;
+	public:
+		PlayerID() = default;
+		//  ID     
+		explicit PlayerID(std::string_view id);
+
+		PlayerID(PlayerID const& other) : entry(other.entry)
+		{
+			if (entry)
+				entry->references.fetch_add(1, std::memory_order_relaxed);
+		}
+		PlayerID(PlayerID&& other) noexcept : entry(other.entry)
+		{
+			other.entry = nullptr;
+		}
+		PlayerID& operator= (PlayerID other) noexcept
+		{
+			std::swap(entry, other.entry);
+			return *this;
+		}
+		~PlayerID()
+		{
+			//     ,      
+			if (entry && entry->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				RemoveEntry();
+		}
+
+		/*
+		*  ID,  ,    PlayerID    
+		* ,   ,  
+		*/
+		String const& ToString() const;
+
+		//    ,  ,        PlayerID
+		uint32_t GetHandle() const
+		{
+			return entry ? entry->handle : 0;
+		}
+		bool Empty() const
+		{
+			return entry == nullptr;
+		}
+
+		friend bool operator== (PlayerID const& a, PlayerID const& b)
+		{
+			return a.entry == b.entry;
+		}
+		friend std::strong_ordering operator<=> (PlayerID const& a, PlayerID const& b)
+		{
+			return a.GetHandle() <=> b.GetHandle();
+		}
+	};
+
+	std::ostream& operator<< (std::ostream& out, PlayerID const& id);
+	std::istream& operator>> (std::istream& in, PlayerID& id);
 
 	/*
 	*        
@@ -89,9 +212,14 @@ namespace conn
 		PlayerID id;
 		String nickname;
 
-		Player(PlayerID id, String nickname) : id(id), nickname(nickname) {}
+		Player(PlayerID id, String nickname) : id(std::move(id)), nickname(std::move(nickname)) {}
 	};
 
+	/*
+	*   ,      
+	*/
+	typedef std::shared_ptr<const std::vector<Player>> PlayersSnapshot;
+
 	/*
 	*   
 	*     
@@ -107,7 +235,7 @@ namespace conn
 		MessageID messageId;
 		String message;
 
-		Message(PlayerID senderId, MessageID messageId, String message) : senderId(senderId), messageId(messageId), message(message) {}
+		Message(PlayerID senderId, MessageID messageId, String message) : senderId(std::move(senderId)), messageId(messageId), message(std::move(message)) {}
 	};
 
 	namespace beast = boost::beast;         // from <boost/beast.hpp>
@@ -116,6 +244,63 @@ namespace conn
 	namespace net = boost::asio;            // from <boost/asio.hpp>
 	using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
+	/*
+	*    ,     
+	*      
+	*/
+	class CancellationToken
+	{
+		friend class CancellationSource;
+		struct State;
+		std::shared_ptr<State> state;
+	public:
+		CancellationToken() = default;
+
+		bool IsCancelled() const;
+		//  false    ,     
+		bool CanBeCancelled() const;
+
+		/*
+		*  callback      ,  Cancel,      - 
+		*     Unsubscribe
+		*/
+		uint64_t Subscribe(std::function<void()> callback) const;
+
+		/*
+		*  ,   callback   
+		*  callback    ,   
+		*/
+		void Unsubscribe(uint64_t subscription) const;
+	};
+
+	/*
+	*  : Cancel   ,    
+	*/
+	class CancellationSource
+	{
+		std::shared_ptr<CancellationToken::State> state;
+	public:
+		CancellationSource();
+
+		CancellationToken GetToken() const;
+		bool IsCancelled() const;
+
+		//      ,     
+		void Cancel();
+	};
+
+	/*
+	*     
+	* ,     ,      ,   
+	*/
+	struct CallOptions
+	{
+		//     ,  0    ConnectionOptions::requestTimeout
+		std::chrono::milliseconds timeout{ 0 };
+
+		CancellationToken cancellation;
+	};
+
 	/*
 	*      
 	*/
@@ -126,7 +311,12 @@ namespace conn
 		*     
 		*         , , ,    
 		*/
-		static bool IsValidMessage(String message);
+		static bool IsValidMessage(std::string_view message);
+
+		/*
+		*      , i-    IsValidMessage(messages[i])
+		*/
+		static std::vector<bool> AreValidMessages(std::span<const String> messages);
 
 		static const size_t MAX_NICKNAME_SIZE = 16;
 		/*
@@ -135,7 +325,7 @@ namespace conn
 		*       MAX_NICKNAME_SIZE
 		*  MAX_NICKNAME_SIZE == -1,     
 		*/
-		static bool IsValidNickname(String nickname);
+		static bool IsValidNickname(std::string_view nickname);
 
 		/*
 		*   
@@ -193,23 +383,23 @@ namespace conn
 		*            ,  NicknameException
 		*          IsValidNickname
 		*/
-		void Register(String nickname);
+		void Register(String nickname, CallOptions const& call = CallOptions());
 
 		/*
 		*    ,    
 		*    ,  StateException
 		*/
-		std::vector<Player> GetPlayers();
+		std::vector<Player> GetPlayers(CallOptions const& call = CallOptions());
 
 		/*
 		*       
 		*    ,  StateException
 		*  sendTo    ,  UnknownPlayerIdException
 		*/
-		void SendOffer(PlayerID sendTo);
+		void SendOffer(PlayerID sendTo, CallOptions const& call = CallOptions());
 
 		/*
-		*   ,    
+		*   ,    ,       
 		*    ,  StateException
 		*/
 		std::vector<PlayerID> GetOffers();
@@ -246,20 +436,91 @@ namespace conn
 		*     ,  MessageException
 		*          IsValidMessage
 		*/
-		void SendMessage(String message);
+		void SendMessage(String message, CallOptions const& call = CallOptions());
+
+		/*
+		*    ,        
+		*         : nullptr    ,    SendMessage
+		* ,   ,     MessageException
+		*      ,  StateException
+		*/
+		std::vector<std::exception_ptr> SendMessages(std::span<const String> messages, CallOptions const& call = CallOptions());
 
 		/*
 		*            
 		*      ,  StateException
 		*/
-		void EndGame();
+		void EndGame(CallOptions const& call = CallOptions());
+
+		/*
+		* ,   ,  CallOptions
+		*      ,  TimeoutException,   - CancelledException
+		*/
+
+		/*
+		*       ,  co_await conn.SendMessageAsync(...)
+		*      ,   ,     
+		*        
+		*/
+		net::awaitable<void>				RegisterAsync(String nickname, CallOptions call = CallOptions());
+		net::awaitable<std::vector<Player>>	GetPlayersAsync(CallOptions call = CallOptions());
+		net::awaitable<void>				SendOfferAsync(PlayerID sendTo, CallOptions call = CallOptions());
+		net::awaitable<void>				SendMessageAsync(String message, CallOptions call = CallOptions());
+		net::awaitable<std::vector<std::exception_ptr>>	SendMessagesAsync(std::span<const String> messages, CallOptions call = CallOptions());
+		net::awaitable<void>				EndGameAsync(CallOptions call = CallOptions());
+
+		typedef std::function<void(Message const& message)>	MessageCallback;
+		typedef std::function<void(PlayerID const& from)>		OfferCallback;
+		typedef std::function<void(PlayerID const& opponent)>	GameStartedCallback;
+		typedef std::function<void()>							GameEndedCallback;
+
+		// ,    InboxOptions
+		enum class LimitedList
+		{
+			Messages,
+			Offers,
+		};
+		typedef std::function<void(LimitedList list, size_t size)>	HighWaterMarkCallback;
+
+		/*
+		*     ,      
+		*    ,    
+		*    ,  SetEventExecutor
+		*/
+		void OnMessage(MessageCallback callback);
+		void OnOffer(OfferCallback callback);
+		void OnGameStarted(GameStartedCallback callback);
+		void OnGameEnded(GameEndedCallback callback);
+
+		/*
+		* ,       InboxOptions,   
+		*     ,       
+		*/
+		void OnHighWaterMark(HighWaterMarkCallback callback);
+
+		/*
+		*  ,     
+		*        ,       ,
+		*      
+		*/
+		void SetEventExecutor(net::any_io_executor executor);
 	protected:
-		State state;
+		//    ,   
+		std::atomic<State> state{ State::NotConnected };
 		PlayerID id;
 
-		virtual void					_Register(String nickname) = 0;
-		virtual std::vector<Player>		_GetPlayers() = 0;
-		virtual void					_SendOffer(PlayerID sendTo) = 0;
+		//      
+		bool HasMessageCallback();
+		void NotifyMessage(Message const& message);
+		void NotifyOffer(PlayerID const& from);
+		void NotifyGameStarted(PlayerID const& opponent);
+		void NotifyGameEnded();
+		void NotifyHighWaterMark(LimitedList list, size_t size);
+
+		virtual PlayerID				_GetID() = 0;
+		virtual void					_Register(String nickname, CallOptions const& call) = 0;
+		virtual std::vector<Player>		_GetPlayers(CallOptions const& call) = 0;
+		virtual void					_SendOffer(PlayerID sendTo, CallOptions const& call) = 0;
 		virtual std::vector<PlayerID>	_GetOffers() = 0;
 		virtual std::vector<Message>	_GetMessages() = 0;
 		virtual void					_RemoveMessage(MessageID id) = 0;
@@ -269,67 +530,856 @@ namespace conn
 		virtual std::vector<Message>	_GetAllMessages() = 0;
 #endif
 
-		virtual void					_SendMessage(String message) = 0;
-		virtual void					_EndGame() = 0;
+		virtual void					_SendMessage(String message, CallOptions const& call) = 0;
+		virtual std::vector<std::exception_ptr>	_SendMessages(std::vector<String> messages, CallOptions const& call) = 0;
+		virtual void					_EndGame(CallOptions const& call) = 0;
+
+		virtual net::awaitable<void>				_RegisterAsync(String nickname, CallOptions call) = 0;
+		virtual net::awaitable<std::vector<Player>>	_GetPlayersAsync(CallOptions call) = 0;
+		virtual net::awaitable<void>				_SendOfferAsync(PlayerID sendTo, CallOptions call) = 0;
+		virtual net::awaitable<void>				_SendMessageAsync(String message, CallOptions call) = 0;
+		virtual net::awaitable<std::vector<std::exception_ptr>>	_SendMessagesAsync(std::vector<String> messages, CallOptions call) = 0;
+		virtual net::awaitable<void>				_EndGameAsync(CallOptions call) = 0;
+	private:
+		std::mutex eventMutex;
+		net::any_io_executor eventExecutor;
+
+		MessageCallback messageCallback;
+		OfferCallback offerCallback;
+		GameStartedCallback gameStartedCallback;
+		GameEndedCallback gameEndedCallback;
+		HighWaterMarkCallback highWaterMarkCallback;
+
+		template <typename Callback, typename... Args>
+		void Notify(Callback GameConnection::* callback, Args const&... args)
+		{
+			std::lock_guard<std::mutex> lock(eventMutex);
+			if (!(this->*callback))
+				return;
+
+			net::post(eventExecutor, [callback = this->*callback, args...]() {
+				callback(args...);
+			});
+		}
 	};
 
 
+	/*
+	*  -   ,     
+	*       
+	*/
+	class ConnectionContext
+	{
+		net::io_context ioc;
+		net::executor_work_guard<net::io_context::executor_type> work{ ioc.get_executor() };
+		std::vector<std::thread> threads;
+	public:
+		/*
+		*  threadCount ,  -   
+		*       
+		*/
+		explicit ConnectionContext(size_t threadCount = std::thread::hardware_concurrency());
+
+		/*
+		*  
+		*  ,  ,      
+		*/
+		~ConnectionContext();
+
+		ConnectionContext(ConnectionContext const&) = delete;
+		ConnectionContext& operator= (ConnectionContext const&) = delete;
+
+		net::io_context& GetIoContext();
+		size_t GetThreadCount() const;
+	};
+
+	/*
+	*      
+	*        ,          
+	*/
+	class ResolverCache
+	{
+	public:
+		typedef std::function<void(beast::error_code ec, tcp::resolver::results_type results)> ResolveHandler;
+	private:
+		struct Entry
+		{
+			tcp::resolver::results_type results;
+			std::chrono::steady_clock::time_point expires;
+		};
+
+		std::mutex mutex;
+		//       "host:port"
+		std::unordered_map<std::string, Entry> entries;
+		std::unordered_map<std::string, std::vector<ResolveHandler>> pending;
+		std::chrono::seconds timeToLive{ 60 };
+
+		ResolverCache() = default;
+	public:
+		static ResolverCache& Global();
+
+		ResolverCache(ResolverCache const&) = delete;
+		ResolverCache& operator= (ResolverCache const&) = delete;
+
+		/*
+		*   ,   60 
+		*  0   ,    - 
+		*/
+		void SetTimeToLive(std::chrono::seconds ttl);
+
+		//    ,      
+		void Invalidate(std::string const& host, std::string const& port);
+		void Clear();
+
+		/*
+		*    executor    
+		* handler      ,    executor
+		*/
+		void AsyncResolve(net::any_io_executor executor, std::string const& host, std::string const& port, ResolveHandler handler);
+	};
+
+	/*
+	*     permessage-deflate
+	*  ,      
+	*/
+	struct CompressionOptions
+	{
+		bool enabled = false;
+
+		//        ,  9  15,       
+		int windowBits = 15;
+
+		//      ,       
+		bool noContextTakeover = false;
+
+		/*
+		*   minMessageSize    
+		*    Boost   ,   
+		*/
+		size_t minMessageSize = 0;
+
+		//    0  9
+		int level = 8;
+	};
+
+	/*
+	*    ,     
+	* ,        flushDelay,    Batch
+	*        ,         flushDelay
+	*     -  
+	*/
+	struct CoalescingOptions
+	{
+		bool enabled = false;
+
+		//      ,  0   
+		std::chrono::microseconds flushDelay{ 0 };
+
+		//      
+		size_t maxBatchSize = 64;
+	};
+
+	/*
+	*          , . FrameCapture.hpp
+	*         ReplayCapture
+	*/
+	struct CaptureOptions
+	{
+		//  ,     
+		std::string path;
+
+		//   ,     
+		size_t maxSize = size_t(256) << 20;
+	};
+
+	/*
+	*       ,    
+	*/
+	enum class OverflowPolicy
+	{
+		//      , RemoveMessage     UnknownMessageIdException
+		DropOldest,
+		//     
+		DropNewest,
+		/*
+		*   ,       RemoveMessage
+		*   ,      ,   
+		*/
+		PauseReading,
+	};
+
+	/*
+	*      ,  0   
+	*  OnMessage   ,  - 
+	*/
+	struct InboxOptions
+	{
+		size_t maxMessages = 0;
+		OverflowPolicy messagePolicy = OverflowPolicy::DropOldest;
+
+		//  PauseReading  ,      resumeMessages, 0 -  maxMessages
+		size_t resumeMessages = 0;
+
+		//        ,    PauseReading 
+		size_t maxOffers = 0;
+		OverflowPolicy offerPolicy = OverflowPolicy::DropOldest;
+	};
+
+	/*
+	*      
+	*   ,         ,
+	*  ,     ,  ,       
+	*             ID,
+	* ,    ,    ,      
+	*/
+	struct ReconnectOptions
+	{
+		bool enabled = false;
+
+		//    ,    multiplier  ,    maxDelay
+		std::chrono::milliseconds initialDelay{ 20 };
+		std::chrono::milliseconds maxDelay{ 10000 };
+		double multiplier = 2;
+
+		//  ,     ,      
+		double jitter = 0.5;
+
+		//   ,     , 0 -  
+		size_t maxAttempts = 0;
+
+		//     ,    ConnectionOptions::requestTimeout     0
+		std::chrono::milliseconds registerTimeout{ 5000 };
+	};
+
+#ifdef CONNECTION_TLS
+	/*
+	*  TLS    wss
+	*/
+	struct TlsOptions
+	{
+		//       ,     ,    
+		bool verifyPeer = true;
+
+		//      PEM,     
+		std::string caFile;
+
+		//  TLS 1.2   OpenSSL,  "ECDHE-ECDSA-AES128-GCM-SHA256",       
+		std::string cipherList;
+
+		//   TLS 1.3,  "TLS_AES_128_GCM_SHA256",       
+		std::string cipherSuites;
+
+		/*
+		*            
+		*           ,    
+		*/
+		bool sessionResumption = true;
+	};
+
+	/*
+	*  TLS,   :  OpenSSL     
+	*     ,         
+	*/
+	class TlsContext
+	{
+		net::ssl::context ssl;
+		const bool verifyPeer;
+		const bool sessionResumption;
+
+		//     "host:port",    
+		std::mutex sessionMutex;
+		std::unordered_map<std::string, std::shared_ptr<SSL_SESSION>> sessions;
+
+		//  OpenSSL    ,  TLS 1.3 -     
+		static int NewSessionCallback(SSL* ssl, SSL_SESSION* session);
+	public:
+		/*
+		*   , TLS  1.2  
+		*       ,  ConnectionException
+		*/
+		explicit TlsContext(TlsOptions const& options = TlsOptions());
+
+		TlsContext(TlsContext const&) = delete;
+		TlsContext& operator= (TlsContext const&) = delete;
+
+		net::ssl::context& GetSslContext();
+		bool IsPeerVerified() const;
+
+		/*
+		*   ssl    key      key    ssl
+		* key  ,   ssl
+		*/
+		void AttachSession(SSL* ssl, std::string const& key);
+
+		//     
+		size_t GetSessionCount();
+
+		//   ,     
+		void ClearSessions();
+	};
+#endif
+
+	/*
+	*    
+	*/
+	struct ConnectionOptions
+	{
+		/*
+		*      
+		*     ,   
+		*/
+		bool preferBinaryProtocol = false;
+
+		CompressionOptions compression;
+
+		CoalescingOptions coalescing;
+
+		/*
+		*     GetStats
+		*     4 ,   30   ,        
+		*/
+		bool latencyHistograms = true;
+
+		CaptureOptions capture;
+
+		ReconnectOptions reconnect;
+
+		InboxOptions inbox;
+
+		/*
+		*     ,      connectAttemptDelay,
+		*    ,     
+		*  0      
+		*/
+		std::chrono::milliseconds connectAttemptDelay{ 250 };
+
+		/*
+		*     ,       CallOptions
+		*     TimeoutException    ;  0    
+		*/
+		std::chrono::milliseconds requestTimeout{ 0 };
+
+#ifdef CONNECTION_TLS
+		/*
+		*   wss   ,  nullptr   
+		*        
+		*/
+		std::shared_ptr<TlsContext> tls;
+#endif
+	};
+
+	/*
+	*      GetStats
+	*/
+	struct ConnectionStats
+	{
+		//  websocket    ,  Batch   
+		uint64_t framesIn = 0;
+		uint64_t framesOut = 0;
+		uint64_t bytesIn = 0;
+		uint64_t bytesOut = 0;
+
+		//  , ,       
+		size_t inboxDepth = 0;
+
+		//             
+		size_t storedMessages = 0;
+		size_t storedMessagesPeak = 0;
+		size_t storedOffers = 0;
+		size_t storedOffersPeak = 0;
+
+		//  -  InboxOptions,         
+		uint64_t droppedMessages = 0;
+		uint64_t droppedOffers = 0;
+		uint64_t duplicateOffers = 0;
+		uint64_t readPauses = 0;
+
+		//  :       
+		uint64_t unhandledServerMessages = 0;
+		uint64_t parseErrors = 0;
+
+		//         ,     
+		// ,  ConnectionOptions::latencyHistograms 
+		std::map<String, LatencyHistogram::Snapshot> commandLatency;
+
+		//       
+		LatencyHistogram::Snapshot frameHandling;
+
+		//      TCP    websocket,   TLS
+		std::chrono::nanoseconds connectTime{ 0 };
+
+		//  TLS      
+		bool tlsSessionReused = false;
+
+		//          
+		//  ,  ConnectionOptions::latencyHistograms 
+		uint64_t reconnects = 0;
+		LatencyHistogram::Snapshot reconnectTime;
+	};
+
+	class FrameCaptureWriter;
+	enum class CaptureDirection : uint8_t;
+
 	/*
 	* ,       
 	*   
+	* GetMessages  RemoveMessage       
 	*/
 	class WebSocketAsyncGameConnection : public GameConnection
 	{
 	private:
 		std::string url, port;
 
-		net::io_context ioc;
-		tcp::resolver resolver;
-		websocket::stream<tcp::socket> ws;
-		const net::ip::basic_resolver_results<tcp> results;
+		std::shared_ptr<ConnectionContext> context;
+		//    ws   strand
+		net::strand<net::io_context::executor_type> strand;
+
+		//      wss,     ConnectionOptions::tls
+		typedef websocket::stream<tcp::socket> PlainStream;
+#ifdef CONNECTION_TLS
+		typedef websocket::stream<beast::ssl_stream<tcp::socket>> TlsStream;
+		typedef std::variant<PlainStream, TlsStream> Stream;
+#else
+		typedef std::variant<PlainStream> Stream;
+#endif
+		Stream ws;
+		static Stream MakeStream(net::strand<net::io_context::executor_type> const& strand, ConnectionOptions const& options);
+
+		//  ,   ResolverCache   ,    strand
+		tcp::resolver::results_type results;
+
+		const ConnectionOptions options;
+		//    ,      
+		bool binaryProtocol = false;
 
 		std::mutex dataMutex;
 
-		std::unordered_map<MessageID, String> responses;
+		//    ,    strand
+		struct OutgoingFrame
+		{
+			MessageID messageId;
+			std::string data;
+		};
+		std::deque<OutgoingFrame> writeQueue;
+		bool writing = false;
+
+		//     writeQueue,   
+		size_t framesInFlight = 0;
+		//  Batch,    
+		std::string batchFrame;
+
+		//      
+		net::steady_timer flushTimer;
+		bool flushScheduled = false;
+		void FlushHandler();
+
+		/*
+		*     
+		* error -     (, ,  ),   
+		*/
+		typedef std::function<void(std::exception_ptr error, String response)> ResponseHandler;
+
+		//   ,   
+		static const size_t MAX_PENDING_REQUESTS = 1024;
+
+		// ID  ,     
+		std::atomic<MessageID> nextRequestID{ 0 };
+
+		// ,  ,     
+		struct PendingRequest
+		{
+			ResponseHandler handler;
+			wire::Opcode command = wire::Opcode::Register;
+			std::chrono::steady_clock::time_point sent;
+
+			//  , time_point::max() -  
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+			//    ,    
+			CancellationToken cancellation;
+			uint64_t subscription = 0;
+		};
+
+		//    ,      
+		PendingRequests<MessageID, PendingRequest> responses{ MAX_PENDING_REQUESTS };
+
+		//    responses  ,   dataMutex
+		std::set<std::pair<std::chrono::steady_clock::time_point, MessageID>> deadlines;
+		// ,        deadlineTimer,   dataMutex
+		std::chrono::steady_clock::time_point armedDeadline = std::chrono::steady_clock::time_point::max();
+		net::steady_timer deadlineTimer;
+
+		void ArmDeadlineTimer(std::chrono::steady_clock::time_point deadline);
+		void DeadlineHandler(beast::error_code const& ec);
+
+		/*
+		*          call
+		*    ,  ConnectionException
+		*/
+		void AddRequest(MessageID messageID, PendingRequest request, CallOptions const& call);
+		//    responses      ,  false,    
+		bool ExtractRequest(MessageID messageID, PendingRequest& request);
+
+		//       ,       
+		std::atomic<PlayersSnapshot> playersSnapshot;
+		std::atomic<std::chrono::steady_clock::time_point> playersTime{};
+		std::atomic<uint64_t> playersGeneration{ 0 };
+
+		// ,    ,      
+		std::vector<std::function<void(std::exception_ptr error, PlayersSnapshot players)>> listHandlers;
+		bool listRequested = false;
+
+		//     , 0 -  
+		std::atomic<std::chrono::milliseconds> playersRefreshInterval{ std::chrono::milliseconds(0) };
+		net::steady_timer refreshTimer;
 
-		std::string listResponse;
-		bool listUpdated;
+		void ScheduleRefresh();
+		void RefreshHandler(beast::error_code const& ec);
 
-		//      
+		//       ,   dataMutex
 		std::vector<PlayerID> offers;
+		//      OnHighWaterMark  ,   dataMutex
+		bool offersFull = false;
+		//       ,   dataMutex
+		void ClearOffers();
 
 		// ID 
 		PlayerID opponentID;
 
-		//   ID  
+		//      ID   
 		MessageID GetMessageID();
+		std::atomic<MessageID> nextMessageID{ 0 };
+
+		/*
+		*         ,      
+		* ,  ,    ,        
+		*/
+		RecyclingPool messagePool;
+
+		/*
+		*    
+		*   reset     ,     ,
+		*      opponent
+		*/
+		struct InboxEntry
+		{
+			bool reset = false;
+			PlayerID opponent;
+			MessageID messageId = 0;
+			std::pmr::string text;
+		};
+
+		//  ,      
+		MpscQueue<InboxEntry> inbox{ &messagePool };
+
+		/*
+		*    inbox:   , unparsedMessages  inboxOpponent
+		* ,  ,   , strand -      InboxOptions::maxMessages
+		*/
+		std::mutex inboxMutex;
+
+		//     inbox  unparsedMessages,   inboxMutex
+		void DrainInbox();
+
+		//    unparsedMessages
+		PlayerID inboxOpponent;
 
-		//   
-		std::unordered_map<MessageID, Message> unparsedMessages;
+		//   unparsedMessages,   inboxMutex
+		std::pmr::unsynchronized_pool_resource readerPool;
+
+		//     messagePool,    map    readerPool
+		struct UnparsedText
+		{
+			std::pmr::string text;
+		};
+
+		//       
+		std::pmr::map<MessageID, UnparsedText> unparsedMessages{ &readerPool };
+
+		/*
+		*  InboxOptions   ,   strand
+		*  false,    
+		*/
+		bool ReserveMessage();
+		//      OnHighWaterMark  ,    strand
+		bool messagesFull = false;
+
+		//   - PauseReading,   inboxMutex
+		bool readPaused = false;
+		//  ,     maxMessages,   strand   
+		bool PauseReadingIfFull();
+		//  ,      resumeMessages,   inboxMutex
+		void ResumeReadingIfDrained();
 
 #ifdef _DEBUG
 		//   
 		std::set<Message> parsedMessages;
 #endif
 
-		bool stopRecieving;
-		std::thread recieverThread;
+		//      ws,    strand
+		size_t activeOperations = 0;
+		bool closing = false;
+		std::promise<void> closed;
+
+		void OperationFinished();
+
+		//     
+		std::atomic<uint64_t> framesIn{ 0 };
+		std::atomic<uint64_t> framesOut{ 0 };
+		std::atomic<uint64_t> bytesIn{ 0 };
+		std::atomic<uint64_t> bytesOut{ 0 };
+		std::atomic<size_t> inboxDepth{ 0 };
+		std::atomic<size_t> storedMessages{ 0 };
+		std::atomic<size_t> storedMessagesPeak{ 0 };
+		std::atomic<size_t> storedOffers{ 0 };
+		std::atomic<size_t> storedOffersPeak{ 0 };
+		std::atomic<uint64_t> droppedMessages{ 0 };
+		std::atomic<uint64_t> droppedOffers{ 0 };
+		std::atomic<uint64_t> duplicateOffers{ 0 };
+		std::atomic<uint64_t> readPauses{ 0 };
+		std::atomic<uint64_t> unhandledServerMessages{ 0 };
+		std::atomic<uint64_t> parseErrors{ 0 };
+
+		static const size_t COMMAND_COUNT = static_cast<size_t>(wire::Opcode::EndGame);
+
+		//  ,    ConnectionOptions::latencyHistograms
+		struct LatencyHistograms
+		{
+			//  ,  -    
+			std::array<LatencyHistogram, COMMAND_COUNT> commands;
+			LatencyHistogram frameHandling;
+			LatencyHistogram reconnectTime;
+		};
+		std::unique_ptr<LatencyHistograms> histograms;
+
+
+		//   ,    
+		void HandlePlayerId(std::string_view playerId);
+		void HandlePlayers(PlayersSnapshot players);
+		void HandleOffer(std::string_view from);
+		void HandleGameStarted(std::string_view opponent);
+		void HandleGameEnded();
+		void HandleChatMessage(std::string_view text);
+		void HandleResponse(MessageID messageID, String response);
 
+		//    ,     
+		void ParseServerMessage(std::string_view message);
+		void ParseResponse(std::string_view id, std::string_view message);
 
-		void ParseServerMessage(std::string message);
-		void ParseResponse(std::string id, std::string message);
+		void ParseMessage(std::string_view message);
+		void ParseBinaryMessage(std::string_view message);
 
-		void ParseMessage(std::string message);
+		//       ,    
+		void HandleFrame(std::string_view frame);
+
+		//  ,    strand
+		std::unique_ptr<FrameCaptureWriter> capture;
+		//    ,   ;     ,   
+		void CaptureFrame(CaptureDirection direction, std::string_view frame);
+
+		//       
+		const bool offline = false;
+		struct OfflineTag {};
+		WebSocketAsyncGameConnection(OfflineTag, std::shared_ptr<ConnectionContext> context, bool binaryProtocol);
 
 		beast::flat_buffer buffer;
 		void MessageHandler(beast::error_code const& ec, std::size_t bytes_written);
+		void ReadNext();
 
-		void RecieveMessages();
+		// ,   AsyncConnect,     
+		struct DeferredTag {};
+		WebSocketAsyncGameConnection(DeferredTag, std::shared_ptr<ConnectionContext> context, std::string url, std::string port, ConnectionOptions options);
 
+		//    ,     
 		void Connect();
 
-		void Send(String message);
-		void Send(String command, String data);
+		//       ,   strand
+		net::awaitable<void> Start();
+		//  ,     ,    
+		bool started = false;
+
+		typedef std::function<void(std::exception_ptr error, std::unique_ptr<WebSocketAsyncGameConnection> connection)> ConnectHandler;
+		static void StartConnect(std::shared_ptr<ConnectionContext> context, std::string url, std::string port, ConnectionOptions options,
+			ConnectHandler handler);
+
+		//    TLS  websocket,   strand
+		net::awaitable<void> Handshake();
+		net::awaitable<tcp::resolver::results_type> Resolve();
+
+		//      , Cancel  
+		class EndpointRace;
+		std::shared_ptr<EndpointRace> race;
+		net::awaitable<void> ConnectEndpoints(tcp::socket& socket);
+		template <typename WebSocket>
+		net::awaitable<void> HandshakeStream(WebSocket& stream);
+
+		//    ,       
+		void ResetStream();
+
+		//   ,   
+		std::atomic<std::chrono::nanoseconds> connectTime{ std::chrono::nanoseconds(0) };
+		std::atomic<bool> tlsSessionReused{ false };
+
+#ifdef CONNECTION_TLS
+		//  ,     TLS  
+		std::string tlsSessionKey;
+		net::awaitable<void> TlsHandshake(beast::ssl_stream<tcp::socket>& stream);
+#endif
+
+		//     
+		enum class LinkState
+		{
+			Up,
+			//    ,    writeQueue
+			Down,
+			//     ,    
+			Lost,
+		};
+		std::atomic<LinkState> link{ LinkState::Up };
+
+		//  ,    strand
+		bool reading = false;
+		bool reconnecting = false;
+		bool recovering = false;
+		size_t reconnectAttempts = 0;
+		State restoreState = State::NotConnected;
+		std::chrono::steady_clock::time_point downSince;
+		net::steady_timer reconnectTimer;
+		std::minstd_rand random;
+
+		// ,    ,    
+		String nickname;
+
+		std::atomic<uint64_t> reconnects{ 0 };
+
+		//   ,    
+		void LinkFailed(std::string const& reason);
+		//   ,      
+		void TryReconnect();
+		net::awaitable<void> Reconnect();
+		std::chrono::milliseconds ReconnectDelay();
+		//   ,    
+		net::awaitable<void> Reregister();
+		//    ,     
+		void LinkLost(std::string const& reason);
+		//   ,    
+		void FailSentRequests(std::string const& reason);
+		void FailListHandlers(std::string const& reason);
+
+		//   
+		void Registered(String nickname);
+
+		//      ,     
+		void Write(OutgoingFrame frame);
+		void WriteNext();
+		void WriteHandler(beast::error_code const& ec, std::size_t bytes_transferred);
+		/*
+		*        
+		*        WriteHandler,      
+		*/
+		void FailQueuedFrames(std::string const& reason);
+
+		//   ,     
+		void FailRequest(MessageID messageID, std::exception_ptr error);
+		void FailRequest(MessageID messageID, std::string const& reason);
+
+		//      
+		std::string EncodeRequest(MessageID messageID, wire::Opcode command, std::string_view data);
+
+		/*
+		*    , handler         
+		*    ,  ,      
+		*/
+		void SendAsync(wire::Opcode command, String data, CallOptions const& call, ResponseHandler handler);
+		std::future<String> SendAsync(wire::Opcode command, String data, CallOptions const& call);
+
+		//  ConnectionException,    
+		static void CheckResponse(String const& response);
+
+		void Send(wire::Opcode command, String data, CallOptions const& call);
+
+		PlayersSnapshot ParsePlayers(std::string_view list);
+		PlayersSnapshot ParseBinaryPlayers(wire::FrameReader& reader);
+
+		/*
+		*     ,       
+		*    ,    
+		*/
+		template <typename... Args, typename Handler>
+		std::function<void(Args...)> BindToExecutor(Handler handler)
+		{
+			auto executor = net::prefer(
+				net::get_associated_executor(handler, strand),
+				net::execution::outstanding_work.tracked);
+			auto sharedHandler = std::make_shared<Handler>(std::move(handler));
+
+			return [executor, sharedHandler](Args... args) {
+				net::post(executor, [sharedHandler, args...]() mutable {
+					(*sharedHandler)(std::move(args)...);
+				});
+			};
+		}
+
+		/*
+		*  ,   ,    
+		*/
+		void SendCheckedAsync(wire::Opcode command, String data, CallOptions const& call, std::function<void(std::exception_ptr error)> handler);
+
+		/*
+		*   ,       
+		*    ,          
+		*     call     ,     
+		*/
+		void RequestListAsync(CallOptions const& call, std::function<void(std::exception_ptr error, PlayersSnapshot players)> handler);
+		//   ,         call,    
+		std::function<void(std::exception_ptr error, PlayersSnapshot players)> GuardListHandler(CallOptions const& call,
+			std::function<void(std::exception_ptr error, PlayersSnapshot players)> handler);
+
+		/*
+		*    ,        :
+		*          ,    
+		*/
+		PlayersSnapshot GetCachedPlayers();
+
+		template <typename CompletionToken>
+		auto AsyncSend(wire::Opcode command, String data, CallOptions const& call, CompletionToken&& token)
+		{
+			return net::async_initiate<CompletionToken, void(std::exception_ptr)>(
+				[this](auto handler, wire::Opcode command, String data, CallOptions const& call) {
+					SendCheckedAsync(command, std::move(data), call, BindToExecutor<std::exception_ptr>(std::move(handler)));
+				}, token, command, std::move(data), call);
+		}
+
+		//     ,   
+		static const size_t MAX_BATCH_IN_FLIGHT = MAX_PENDING_REQUESTS / 2;
+
+		/*
+		*  ,     ,       
+		*      MAX_BATCH_IN_FLIGHT ,        
+		*/
+		void SendBatchAsync(std::vector<String> messages, CallOptions const& call, std::function<void(std::vector<std::exception_ptr> results)> handler);
+
+		//   SendBatchAsync   
+		struct OutgoingBatch;
+		//    ,     MAX_BATCH_IN_FLIGHT  
+		void SendBatchNext(std::shared_ptr<OutgoingBatch> batch);
+
+		template <typename CompletionToken>
+		auto AsyncSendBatch(std::vector<String> messages, CallOptions const& call, CompletionToken&& token)
+		{
+			return net::async_initiate<CompletionToken, void(std::vector<std::exception_ptr>)>(
+				[this](auto handler, std::vector<String> messages, CallOptions const& call) {
+					SendBatchAsync(std::move(messages), call, BindToExecutor<std::vector<std::exception_ptr>>(std::move(handler)));
+				}, token, std::move(messages), call);
+		}
+
+		template <typename CompletionToken>
+		auto AsyncRequestList(CallOptions const& call, CompletionToken&& token)
+		{
+			return net::async_initiate<CompletionToken, void(std::exception_ptr, PlayersSnapshot)>(
+				[this](auto handler, CallOptions const& call) {
+					RequestListAsync(call, BindToExecutor<std::exception_ptr, PlayersSnapshot>(std::move(handler)));
+				}, token, call);
+		}
 	public:
 		//   
 		static const std::string DEFAULT_URL;
@@ -349,15 +1399,97 @@ namespace conn
 		*/
 		WebSocketAsyncGameConnection(std::string url, std::string port);
 
+		/*
+		*      websocket,    -
+		*     ConnectionException
+		*/
+		WebSocketAsyncGameConnection(std::shared_ptr<ConnectionContext> context, std::string url = DEFAULT_URL, std::string port = DEFAULT_PORT,
+			ConnectionOptions options = ConnectionOptions());
+
+		/*
+		*  ,     ,   ,   ReplayFrame
+		*        
+		*/
+		static std::unique_ptr<WebSocketAsyncGameConnection> CreateOffline(std::shared_ptr<ConnectionContext> context, bool binaryProtocol);
+
+		/*
+		*  ,    :  ,       context
+		*       ,       
+		*       Registration  ConnectionException
+		*  -  void(std::exception_ptr, std::unique_ptr<WebSocketAsyncGameConnection>), net::use_future  net::use_awaitable
+		*/
+		template <typename CompletionToken>
+		static auto AsyncConnect(std::shared_ptr<ConnectionContext> context, std::string url, std::string port, ConnectionOptions options,
+			CompletionToken&& token)
+		{
+			return net::async_initiate<CompletionToken, void(std::exception_ptr, std::unique_ptr<WebSocketAsyncGameConnection>)>(
+				[](auto handler, std::shared_ptr<ConnectionContext> context, std::string url, std::string port, ConnectionOptions options) {
+					auto executor = net::prefer(
+						net::get_associated_executor(handler, context->GetIoContext().get_executor()),
+						net::execution::outstanding_work.tracked);
+					auto sharedHandler = std::make_shared<decltype(handler)>(std::move(handler));
+
+					// BindToExecutor  ,     
+					StartConnect(std::move(context), std::move(url), std::move(port), std::move(options),
+						[executor, sharedHandler](std::exception_ptr error, std::unique_ptr<WebSocketAsyncGameConnection> connection) {
+							net::post(executor, [sharedHandler, error, connection = std::move(connection)]() mutable {
+								(*sharedHandler)(error, std::move(connection));
+							});
+						});
+				}, token, std::move(context), std::move(url), std::move(port), std::move(options));
+		}
+
+		/*
+		*      ,    ,   
+		*  ReplayFrame    
+		*     CreateOffline,  StateException
+		*/
+		void ReplayFrame(std::string_view frame);
+
+		//  true,      
+		bool IsBinaryProtocol() const;
+
+		/*
+		*  false,         
+		*    GetState    
+		*/
+		bool IsConnected() const;
+
+		/*
+		*   
+		*      ,         
+		*/
+		ConnectionStats GetStats() const;
+
+		/*
+		*         
+		*     ,  nullptr
+		*/
+		PlayersSnapshot GetPlayersSnapshot();
+
+		/*
+		*     ,       
+		*/
+		uint64_t GetPlayersGeneration();
+
+		/*
+		*        interval,      
+		*   , GetPlayers          
+		*  interval == 0    GetPlayers      
+		*/
+		void SetPlayersRefreshInterval(std::chrono::milliseconds interval);
+
 		/*
 		*    
 		*         
+		*     ,          
 		*/
 		~WebSocketAsyncGameConnection();
 	protected:
-		void					_Register(String nickname);
-		std::vector<Player>		_GetPlayers();
-		void					_SendOffer(PlayerID sendTo);
+		PlayerID				_GetID();
+		void					_Register(String nickname, CallOptions const& call);
+		std::vector<Player>		_GetPlayers(CallOptions const& call);
+		void					_SendOffer(PlayerID sendTo, CallOptions const& call);
 		std::vector<PlayerID>	_GetOffers();
 		std::vector<Message>	_GetMessages();
 		void					_RemoveMessage(MessageID id);
@@ -367,7 +1499,24 @@ namespace conn
 		std::vector<Message>	_GetAllMessages();
 #endif
 
-		void					_SendMessage(String message);
-		void					_EndGame();
+		void					_SendMessage(String message, CallOptions const& call);
+		std::vector<std::exception_ptr>	_SendMessages(std::vector<String> messages, CallOptions const& call);
+		void					_EndGame(CallOptions const& call);
+
+		net::awaitable<void>				_RegisterAsync(String nickname, CallOptions call);
+		net::awaitable<std::vector<Player>>	_GetPlayersAsync(CallOptions call);
+		net::awaitable<void>				_SendOfferAsync(PlayerID sendTo, CallOptions call);
+		net::awaitable<void>				_SendMessageAsync(String message, CallOptions call);
+		net::awaitable<std::vector<std::exception_ptr>>	_SendMessagesAsync(std::vector<String> messages, CallOptions call);
+		net::awaitable<void>				_EndGameAsync(CallOptions call);
 	};
-}
\ No newline at end of file
+}
+
+template <>
+struct std::hash<conn::PlayerID>
+{
+	size_t operator() (conn::PlayerID const& id) const noexcept
+	{
+		return std::hash<uint32_t>()(id.GetHandle());
+	}
+};
@@ -0,0 +1,336 @@
+#include "FrameCapture.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace conn
+{
+	static const char CAPTURE_MAGIC[4] = { 'G', 'C', 'A', 'P' };
+	static const uint8_t CAPTURE_VERSION = 1;
+	static const uint8_t CAPTURE_BINARY_PROTOCOL = 0x01;
+	static const size_t CAPTURE_HEADER_SIZE = 16;
+
+	//   ,   
+	static const size_t INITIAL_CAPTURE_SIZE = 1 << 20;
+
+	/*
+	*     
+	*     
+	*/
+	class MappedFile
+	{
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#else
+		int fd = -1;
+#endif
+		char* data = nullptr;
+		size_t size = 0;
+		bool writable = false;
+
+		void Unmap()
+		{
+			if (!data)
+				return;
+#ifdef _WIN32
+			UnmapViewOfFile(data);
+			CloseHandle(mapping);
+			mapping = NULL;
+#else
+			munmap(data, size);
+#endif
+			data = nullptr;
+		}
+		void Map()
+		{
+			if (size == 0)
+				return;
+#ifdef _WIN32
+			mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+				static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), NULL);
+			if (mapping == NULL)
+				throw CaptureException("Failed to map the capture file");
+
+			data = static_cast<char*>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+			if (!data)
+			{
+				CloseHandle(mapping);
+				mapping = NULL;
+				throw CaptureException("Failed to map the capture file");
+			}
+#else
+			void* address = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+			if (address == MAP_FAILED)
+				throw CaptureException("Failed to map the capture file");
+			data = static_cast<char*>(address);
+#endif
+		}
+		void SetFileSize(size_t newSize)
+		{
+#ifdef _WIN32
+			LARGE_INTEGER position;
+			position.QuadPart = static_cast<LONGLONG>(newSize);
+			if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+				throw CaptureException("Failed to resize the capture file");
+#else
+			if (ftruncate(fd, static_cast<off_t>(newSize)) != 0)
+				throw CaptureException("Failed to resize the capture file");
+#endif
+		}
+	public:
+		MappedFile(std::string const& path, bool writable) : writable(writable)
+		{
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+				writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+				throw CaptureException("Failed to open the capture file: " + path);
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize))
+			{
+				CloseHandle(file);
+				throw CaptureException("Failed to open the capture file: " + path);
+			}
+			size = static_cast<size_t>(fileSize.QuadPart);
+#else
+			fd = writable ? open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				throw CaptureException("Failed to open the capture file: " + path);
+
+			struct stat status;
+			if (fstat(fd, &status) != 0)
+			{
+				close(fd);
+				throw CaptureException("Failed to open the capture file: " + path);
+			}
+			size = static_cast<size_t>(status.st_size);
+#endif
+			try
+			{
+				Map();
+			}
+			catch (...)
+			{
+				Close();
+				throw;
+			}
+		}
+		~MappedFile()
+		{
+			Close();
+		}
+
+		MappedFile(MappedFile const&) = delete;
+		MappedFile& operator= (MappedFile const&) = delete;
+
+		//       ,    
+		void Resize(size_t newSize)
+		{
+			Unmap();
+			SetFileSize(newSize);
+			size = newSize;
+			Map();
+		}
+
+		//       newSize 
+		void Truncate(size_t newSize)
+		{
+			Unmap();
+			try
+			{
+				SetFileSize(newSize);
+			}
+			catch (CaptureException const&)
+			{
+				// the tail is zero filled, so the reader still finds the end of the frames
+			}
+			size = newSize;
+		}
+
+		void Close()
+		{
+			Unmap();
+#ifdef _WIN32
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+#endif
+		}
+
+		char* GetData() const
+		{
+			return data;
+		}
+		size_t GetSize() const
+		{
+			return size;
+		}
+	};
+
+
+	FrameCaptureWriter::FrameCaptureWriter(std::string const& path, bool binaryProtocol, size_t maxSize) :
+		mapping(std::make_unique<MappedFile>(path, true)), maxSize((std::max)(maxSize, CAPTURE_HEADER_SIZE))
+	{
+		mapping->Resize((std::min)(INITIAL_CAPTURE_SIZE, this->maxSize));
+
+		char* data = mapping->GetData();
+		std::memcpy(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+		data[4] = static_cast<char>(CAPTURE_VERSION);
+		data[5] = static_cast<char>(binaryProtocol ? CAPTURE_BINARY_PROTOCOL : 0);
+		data[6] = data[7] = 0;
+
+		uint64_t startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		for (size_t i = 0; i < 8; i++)
+			data[8 + i] = static_cast<char>(startTime >> (8 * i));
+
+		size = CAPTURE_HEADER_SIZE;
+		last = std::chrono::steady_clock::now();
+	}
+	FrameCaptureWriter::~FrameCaptureWriter()
+	{
+		mapping->Truncate(size);
+	}
+
+	bool FrameCaptureWriter::Append(CaptureDirection direction, std::string_view frame)
+	{
+		if (stopped)
+		{
+			droppedFrames++;
+			return false;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+
+		header.clear();
+		wire::FrameWriter writer(header);
+		writer.WriteByte(static_cast<uint8_t>(direction));
+		writer.WriteVarint(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+		writer.WriteVarint(frame.size());
+
+		size_t needed = header.size() + frame.size();
+		if (needed > maxSize - size)
+		{
+			droppedFrames++;
+			return false;
+		}
+		if (needed > mapping->GetSize() - size)
+		{
+			size_t capacity = (std::max)(mapping->GetSize() * 2, size + needed);
+			mapping->Resize((std::min)(capacity, maxSize));
+		}
+
+		char* data = mapping->GetData() + size;
+		std::memcpy(data, header.data(), header.size());
+		std::memcpy(data + header.size(), frame.data(), frame.size());
+		size += needed;
+		last = now;
+		return true;
+	}
+
+	void FrameCaptureWriter::Stop()
+	{
+		// the mapping may be lost after a failed resize, so nothing is written to it any more
+		stopped = true;
+		droppedFrames++;
+	}
+
+	size_t FrameCaptureWriter::GetSize() const
+	{
+		return size;
+	}
+	uint64_t FrameCaptureWriter::GetDroppedFrames() const
+	{
+		return droppedFrames;
+	}
+
+
+	FrameCaptureReader::FrameCaptureReader(std::string const& path) : mapping(std::make_unique<MappedFile>(path, false))
+	{
+		const char* data = mapping->GetData();
+		if (mapping->GetSize() < CAPTURE_HEADER_SIZE || std::memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+			throw CaptureException("Not a frame capture: " + path);
+		if (static_cast<uint8_t>(data[4]) != CAPTURE_VERSION)
+			throw CaptureException("Unsupported frame capture version: " + std::to_string(static_cast<uint8_t>(data[4])));
+
+		binaryProtocol = (static_cast<uint8_t>(data[5]) & CAPTURE_BINARY_PROTOCOL) != 0;
+
+		uint64_t start = 0;
+		for (size_t i = 0; i < 8; i++)
+			start |= static_cast<uint64_t>(static_cast<uint8_t>(data[8 + i])) << (8 * i);
+		startTime = std::chrono::system_clock::time_point(
+			std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(start)));
+
+		frames = std::string_view(data + CAPTURE_HEADER_SIZE, mapping->GetSize() - CAPTURE_HEADER_SIZE);
+		Rewind();
+	}
+	FrameCaptureReader::~FrameCaptureReader() = default;
+
+	bool FrameCaptureReader::IsBinaryProtocol() const
+	{
+		return binaryProtocol;
+	}
+	std::chrono::system_clock::time_point FrameCaptureReader::GetStartTime() const
+	{
+		return startTime;
+	}
+
+	bool FrameCaptureReader::Next(CapturedFrame& frame)
+	{
+		uint8_t direction;
+		if (!reader.ReadByte(direction) || direction == 0)
+			return false;
+
+		uint64_t delta;
+		if (!reader.ReadVarint(delta) || !reader.ReadString(frame.data))
+			throw CaptureException("Frame capture is damaged");
+		if (direction != static_cast<uint8_t>(CaptureDirection::Inbound) && direction != static_cast<uint8_t>(CaptureDirection::Outbound))
+			throw CaptureException("Frame capture is damaged");
+
+		time += std::chrono::nanoseconds(delta);
+		frame.direction = static_cast<CaptureDirection>(direction);
+		frame.time = time;
+		return true;
+	}
+
+	void FrameCaptureReader::Rewind()
+	{
+		reader = wire::FrameReader(frames);
+		time = std::chrono::nanoseconds(0);
+	}
+
+
+	ReplayStats ReplayCapture(FrameCaptureReader& capture, WebSocketAsyncGameConnection& connection)
+	{
+		ReplayStats stats;
+		capture.Rewind();
+
+		auto start = std::chrono::steady_clock::now();
+		CapturedFrame frame;
+		while (capture.Next(frame))
+		{
+			if (frame.direction != CaptureDirection::Inbound)
+				continue;
+
+			connection.ReplayFrame(frame.data);
+			stats.frames++;
+			stats.bytes += frame.data.size();
+		}
+		stats.elapsed = std::chrono::steady_clock::now() - start;
+		return stats;
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Connection.hpp"
+
+namespace conn
+{
+	class CaptureException : public ConnectionException
+	{
+	public:
+		CaptureException(const std::string& msg) : ConnectionException(msg) {}
+	};
+
+	/*
+	*   :
+	* :  "GCAP" < > < > <2  0> <8        , little-endian>
+	* :       < > <varint    > <varint > < >
+	*    ,    
+	*     ,    ,      
+	*/
+	enum class CaptureDirection : uint8_t
+	{
+		Inbound = 1,
+		Outbound = 2,
+	};
+
+	struct CapturedFrame
+	{
+		CaptureDirection direction = CaptureDirection::Inbound;
+		//    
+		std::chrono::nanoseconds time{ 0 };
+		//      ,   FrameCaptureReader
+		std::string_view data;
+	};
+
+	// ,   ,     
+	class MappedFile;
+
+	/*
+	*     ,   
+	*   ,   Append    strand
+	*/
+	class FrameCaptureWriter
+	{
+		std::unique_ptr<MappedFile> mapping;
+
+		size_t size = 0;
+		size_t maxSize;
+		uint64_t droppedFrames = 0;
+		bool stopped = false;
+
+		std::chrono::steady_clock::time_point last;
+		//   ,  
+		std::string header;
+	public:
+		/*
+		*     path
+		* maxSize -   ,    
+		*     ,  CaptureException
+		*/
+		FrameCaptureWriter(std::string const& path, bool binaryProtocol, size_t maxSize);
+
+		//     
+		~FrameCaptureWriter();
+
+		FrameCaptureWriter(FrameCaptureWriter const&) = delete;
+		FrameCaptureWriter& operator= (FrameCaptureWriter const&) = delete;
+
+		/*
+		*  ,  false,       
+		*     ,  CaptureException,     
+		*/
+		bool Append(CaptureDirection direction, std::string_view frame);
+
+		/*
+		*     Append, ,    ,  
+		*   ,      
+		*/
+		void Stop();
+
+		size_t GetSize() const;
+		uint64_t GetDroppedFrames() const;
+	};
+
+	/*
+	*          
+	*/
+	class FrameCaptureReader
+	{
+		std::unique_ptr<MappedFile> mapping;
+
+		std::string_view frames;
+		wire::FrameReader reader{ std::string_view() };
+		std::chrono::nanoseconds time{ 0 };
+
+		bool binaryProtocol = false;
+		std::chrono::system_clock::time_point startTime;
+	public:
+		/*
+		*    
+		*           ,  CaptureException
+		*/
+		explicit FrameCaptureReader(std::string const& path);
+		~FrameCaptureReader();
+
+		FrameCaptureReader(FrameCaptureReader const&) = delete;
+		FrameCaptureReader& operator= (FrameCaptureReader const&) = delete;
+
+		//     
+		bool IsBinaryProtocol() const;
+		std::chrono::system_clock::time_point GetStartTime() const;
+
+		/*
+		*   ,  false   
+		*   ,  CaptureException
+		*/
+		bool Next(CapturedFrame& frame);
+
+		//    
+		void Rewind();
+	};
+
+	struct ReplayStats
+	{
+		uint64_t frames = 0;
+		uint64_t bytes = 0;
+		std::chrono::nanoseconds elapsed{ 0 };
+	};
+
+	/*
+	*         ,  WebSocketAsyncGameConnection::CreateOffline,  
+	*   
+	*/
+	ReplayStats ReplayCapture(FrameCaptureReader& capture, WebSocketAsyncGameConnection& connection);
+}
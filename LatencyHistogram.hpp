@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace conn
+{
+	/*
+	*    - ,   HDR Histogram
+	*      SUB_BUCKETS ,      1 / SUB_BUCKETS
+	*   MAX_VALUE    
+	* Record        
+	*/
+	class LatencyHistogram
+	{
+	public:
+		static constexpr unsigned SUB_BUCKET_BITS = 4;
+		static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		// 2^36 ns -  68 
+		static constexpr unsigned MAX_VALUE_BITS = 36;
+		static constexpr uint64_t MAX_VALUE = (uint64_t(1) << MAX_VALUE_BITS) - 1;
+		static constexpr size_t BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+		//      Snapshot
+		struct Snapshot
+		{
+			std::vector<uint64_t> buckets;
+			uint64_t count = 0;
+			uint64_t sum = 0;
+			uint64_t minValue = 0;
+			uint64_t maxValue = 0;
+
+			std::chrono::nanoseconds Min() const
+			{
+				return std::chrono::nanoseconds(minValue);
+			}
+			std::chrono::nanoseconds Max() const
+			{
+				return std::chrono::nanoseconds(maxValue);
+			}
+			std::chrono::nanoseconds Mean() const
+			{
+				return std::chrono::nanoseconds(count ? sum / count : 0);
+			}
+
+			//    ,     quantile , quantile  0  1
+			std::chrono::nanoseconds Percentile(double quantile) const
+			{
+				if (count == 0)
+					return std::chrono::nanoseconds(0);
+
+				uint64_t rank = static_cast<uint64_t>(quantile * count);
+				if (rank == 0)
+					rank = 1;
+				if (rank > count)
+					rank = count;
+
+				uint64_t seen = 0;
+				for (size_t i = 0; i < buckets.size(); i++)
+				{
+					seen += buckets[i];
+					if (seen >= rank)
+						return std::chrono::nanoseconds((std::min)(BucketUpperBound(i), maxValue));
+				}
+				return std::chrono::nanoseconds(maxValue);
+			}
+		};
+
+		void Record(std::chrono::nanoseconds duration)
+		{
+			uint64_t value = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+
+			buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+			count.fetch_add(1, std::memory_order_relaxed);
+			sum.fetch_add(value, std::memory_order_relaxed);
+
+			// min and max are rarely changed, so the compare-exchange almost never runs
+			uint64_t current = minValue.load(std::memory_order_relaxed);
+			while (value < current && !minValue.compare_exchange_weak(current, value, std::memory_order_relaxed));
+			current = maxValue.load(std::memory_order_relaxed);
+			while (value > current && !maxValue.compare_exchange_weak(current, value, std::memory_order_relaxed));
+		}
+
+		/*
+		*  
+		* ,    ,     
+		*/
+		Snapshot GetSnapshot() const
+		{
+			Snapshot snapshot;
+			snapshot.buckets.resize(BUCKET_COUNT);
+			for (size_t i = 0; i < BUCKET_COUNT; i++)
+				snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+
+			snapshot.count = count.load(std::memory_order_relaxed);
+			snapshot.sum = sum.load(std::memory_order_relaxed);
+			snapshot.minValue = snapshot.count ? minValue.load(std::memory_order_relaxed) : 0;
+			snapshot.maxValue = maxValue.load(std::memory_order_relaxed);
+			return snapshot;
+		}
+
+		static size_t BucketIndex(uint64_t value)
+		{
+			if (value > MAX_VALUE)
+				value = MAX_VALUE;
+			if (value < SUB_BUCKETS)
+				return static_cast<size_t>(value);
+
+			// the top SUB_BUCKET_BITS + 1 bits select the bucket
+			unsigned exponent = static_cast<unsigned>(std::bit_width(value)) - 1;
+			unsigned shift = exponent - SUB_BUCKET_BITS;
+			return static_cast<size_t>((shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1)));
+		}
+		static uint64_t BucketUpperBound(size_t index)
+		{
+			if (index < SUB_BUCKETS)
+				return index;
+
+			uint64_t shift = index / SUB_BUCKETS - 1;
+			uint64_t sub = index % SUB_BUCKETS;
+			return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+		}
+	private:
+		std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> sum{ 0 };
+		std::atomic<uint64_t> minValue{ UINT64_MAX };
+		std::atomic<uint64_t> maxValue{ 0 };
+	};
+}
@@ -0,0 +1,379 @@
+#include "LoadGenerator.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_future.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <random>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace conn;
+
+namespace loadgen
+{
+	using clock = std::chrono::steady_clock;
+
+	//    ,    ,    
+	const std::chrono::milliseconds WAIT_SLICE(50);
+
+	const char* const LoadGenerator::OPERATION_NAMES[OPERATION_COUNT] = {
+		"connect",
+		"register",
+		"list",
+		"offer",
+		"match",
+		"message ack",
+		"message delivery",
+		"end game",
+	};
+
+	struct LoadGenerator::SimulatedPlayer
+	{
+		size_t index;
+		//        
+		bool leader;
+		std::unique_ptr<WebSocketAsyncGameConnection> connection;
+		PlayerID opponent;
+
+		//      strand 
+		net::strand<net::io_context::executor_type> strand;
+		//   ,   WaitUntil
+		net::steady_timer wakeup;
+		net::steady_timer pace;
+		std::minstd_rand random;
+		bool offered = false;
+		size_t received = 0;
+
+		SimulatedPlayer(size_t index, net::io_context& ioc) : index(index), leader(index % 2 == 0),
+			strand(net::make_strand(ioc)), wakeup(strand), pace(strand), random(static_cast<unsigned>(index + 1))
+		{}
+	};
+
+	//  ,   
+	static std::chrono::duration<double> ProcessCpuTime()
+	{
+#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+			return std::chrono::duration<double>(0);
+
+		auto ticks = [](FILETIME const& time) {
+			return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+		};
+		// FILETIME counts 100 ns intervals
+		return std::chrono::duration<double>((ticks(kernel) + ticks(user)) / 1e7);
+#else
+		rusage usage{};
+		getrusage(RUSAGE_SELF, &usage);
+
+		auto seconds = [](timeval const& time) {
+			return time.tv_sec + time.tv_usec / 1e6;
+		};
+		return std::chrono::duration<double>(seconds(usage.ru_utime) + seconds(usage.ru_stime));
+#endif
+	}
+
+	//     ,          
+	static String MakeChatMessage(size_t number, clock::time_point sent)
+	{
+		return "move " + std::to_string(number) + " at " + std::to_string(sent.time_since_epoch().count());
+	}
+	static bool ParseSendTime(std::string_view message, clock::time_point& sent)
+	{
+		size_t at = message.rfind(' ');
+		if (at == std::string_view::npos)
+			return false;
+
+		clock::rep ticks = 0;
+		auto result = std::from_chars(message.data() + at + 1, message.data() + message.size(), ticks);
+		if (result.ec != std::errc() || result.ptr != message.data() + message.size())
+			return false;
+
+		sent = clock::time_point(clock::duration(ticks));
+		return true;
+	}
+
+	//     OnMessage,    ,       
+	static void ClearInbox(GameConnection& connection)
+	{
+		try
+		{
+			for (Message const& message : connection.GetMessages())
+				connection.RemoveMessage(message.messageId);
+		}
+		catch (StateException const&)
+		{
+			// the opponent has already ended the game, the next game start clears the inbox
+		}
+	}
+
+	LoadGenerator::LoadGenerator(LoadOptions options) : options(std::move(options))
+	{
+		context = std::make_shared<ConnectionContext>((std::max)(this->options.threads, size_t(1)));
+	}
+	LoadGenerator::~LoadGenerator() = default;
+
+	void LoadGenerator::Record(Operation operation, clock::time_point start)
+	{
+		latency[operation].Record(clock::now() - start);
+	}
+	void LoadGenerator::RecordError(std::exception const& e)
+	{
+		errors.fetch_add(1, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(errorMutex);
+		if (firstError.empty())
+			firstError = e.what();
+	}
+
+	net::awaitable<void> LoadGenerator::ConnectPlayers(std::vector<std::unique_ptr<SimulatedPlayer>>& players, std::atomic<size_t>& next)
+	{
+		for (size_t index = next++; index < players.size(); index = next++)
+		{
+			SimulatedPlayer& player = *players[index];
+
+			auto start = clock::now();
+			player.connection = co_await WebSocketAsyncGameConnection::AsyncConnect(context, options.url, options.port, options.connection,
+				net::use_awaitable);
+			Record(Connect, start);
+			Subscribe(player);
+
+			start = clock::now();
+			co_await player.connection->RegisterAsync("load" + std::to_string(index));
+			Record(Register, start);
+		}
+	}
+
+	void LoadGenerator::Subscribe(SimulatedPlayer& player)
+	{
+		GameConnection& connection = *player.connection;
+		connection.SetEventExecutor(player.strand);
+
+		connection.OnOffer([this, &player](PlayerID const& from) {
+			if (from == player.opponent)
+			{
+				player.offered = true;
+				player.wakeup.cancel();
+			}
+		});
+		connection.OnGameStarted([&player](PlayerID const&) {
+			player.wakeup.cancel();
+		});
+		connection.OnGameEnded([&player]() {
+			player.wakeup.cancel();
+		});
+		connection.OnMessage([this, &player](Message const& message) {
+			clock::time_point sent;
+			if (ParseSendTime(message.message, sent))
+				latency[MessageDelivery].Record(clock::now() - sent);
+
+			messagesReceived.fetch_add(1, std::memory_order_relaxed);
+			player.received++;
+			player.wakeup.cancel();
+		});
+	}
+
+	template <typename Condition>
+	net::awaitable<bool> LoadGenerator::WaitUntil(SimulatedPlayer& player, Condition condition)
+	{
+		while (!condition())
+		{
+			if (stopping.load(std::memory_order_relaxed))
+				co_return false;
+
+			// events run in the same strand, so none of them can slip in between the check and the wait
+			beast::error_code ec;
+			player.wakeup.expires_after(WAIT_SLICE);
+			co_await player.wakeup.async_wait(net::redirect_error(net::use_awaitable, ec));
+		}
+		co_return true;
+	}
+
+	net::awaitable<bool> LoadGenerator::FindOpponent(SimulatedPlayer& player)
+	{
+		GameConnection& connection = *player.connection;
+
+		if (options.lobby == LobbyMode::Poll)
+		{
+			while (true)
+			{
+				auto start = clock::now();
+				std::vector<Player> players = co_await connection.GetPlayersAsync();
+				Record(List, start);
+
+				bool found = std::any_of(players.begin(), players.end(), [&](Player const& candidate) {
+					return candidate.id == player.opponent;
+				});
+				if (found)
+					break;
+				if (stopping.load(std::memory_order_relaxed))
+					co_return false;
+
+				beast::error_code ec;
+				player.pace.expires_after(options.pollInterval);
+				co_await player.pace.async_wait(net::redirect_error(net::use_awaitable, ec));
+			}
+		}
+		else if (!player.leader)
+		{
+			if (!co_await WaitUntil(player, [&]() { return player.offered; }))
+				co_return false;
+		}
+		player.offered = false;
+
+		auto start = clock::now();
+		co_await connection.SendOfferAsync(player.opponent);
+		Record(Offer, start);
+
+		if (!co_await WaitUntil(player, [&]() { return connection.GetState() == GameConnection::State::InGame; }))
+			co_return false;
+		Record(Match, start);
+		co_return true;
+	}
+
+	net::awaitable<void> LoadGenerator::Chat(SimulatedPlayer& player)
+	{
+		GameConnection& connection = *player.connection;
+
+		// exponential pauses keep the players from sending in lockstep
+		std::exponential_distribution<double> pause(options.chatRate > 0 ? options.chatRate : 1);
+
+		auto next = clock::now();
+		for (size_t i = 0; i < options.messagesPerGame; i++)
+		{
+			auto start = clock::now();
+			co_await connection.SendMessageAsync(MakeChatMessage(i, start));
+			Record(MessageAck, start);
+			messagesSent.fetch_add(1, std::memory_order_relaxed);
+
+			if (options.chatRate > 0 && i + 1 < options.messagesPerGame)
+			{
+				beast::error_code ec;
+				next += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(pause(player.random)));
+				player.pace.expires_at(next);
+				co_await player.pace.async_wait(net::redirect_error(net::use_awaitable, ec));
+			}
+		}
+	}
+
+	net::awaitable<void> LoadGenerator::Play(SimulatedPlayer& player)
+	{
+		GameConnection& connection = *player.connection;
+		try
+		{
+			while (!stopping.load(std::memory_order_relaxed))
+			{
+				if (!co_await FindOpponent(player))
+					break;
+
+				co_await Chat(player);
+
+				if (player.leader)
+				{
+					if (!co_await WaitUntil(player, [&]() { return player.received >= options.messagesPerGame; }))
+						break;
+
+					ClearInbox(connection);
+
+					auto start = clock::now();
+					co_await connection.EndGameAsync();
+					Record(EndGame, start);
+					games.fetch_add(1, std::memory_order_relaxed);
+				}
+				else
+				{
+					ClearInbox(connection);
+					if (!co_await WaitUntil(player, [&]() { return connection.GetState() == GameConnection::State::Searching; }))
+						break;
+				}
+				player.received = 0;
+			}
+		}
+		catch (std::exception const& e)
+		{
+			RecordError(e);
+		}
+		running.fetch_sub(1, std::memory_order_release);
+	}
+
+	LoadReport LoadGenerator::Run()
+	{
+		size_t count = options.players / 2 * 2;
+
+		std::vector<std::unique_ptr<SimulatedPlayer>> players;
+		players.reserve(count);
+		for (size_t i = 0; i < count; i++)
+			players.push_back(std::make_unique<SimulatedPlayer>(i, context->GetIoContext()));
+
+		// the handshakes of different players overlap, so the startup takes about count / connectConcurrency round trips
+		auto startupStart = clock::now();
+		size_t workers = options.connectConcurrency == 0 ? count : (std::min)(options.connectConcurrency, count);
+		std::atomic<size_t> next{ 0 };
+		std::vector<std::future<void>> connecting;
+		for (size_t i = 0; i < workers; i++)
+			connecting.push_back(net::co_spawn(net::make_strand(context->GetIoContext()), ConnectPlayers(players, next), net::use_future));
+
+		// the other workers use players, so all of them finish before the first error is thrown
+		std::exception_ptr connectError;
+		for (auto& worker : connecting)
+		{
+			try
+			{
+				worker.get();
+			}
+			catch (...)
+			{
+				if (!connectError)
+					connectError = std::current_exception();
+			}
+		}
+		if (connectError)
+			std::rethrow_exception(connectError);
+		auto startup = clock::now() - startupStart;
+
+		for (size_t i = 0; i < count; i++)
+			players[i]->opponent = players[i ^ 1]->connection->GetID();
+
+		auto cpuStart = ProcessCpuTime();
+		auto start = clock::now();
+
+		running.store(count);
+		for (auto& player : players)
+			net::co_spawn(player->strand, Play(*player), net::detached);
+
+		std::this_thread::sleep_until(start + options.duration);
+		stopping.store(true);
+
+		// the games in progress are played to the end
+		while (running.load(std::memory_order_acquire) != 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		LoadReport report;
+		report.players = count;
+		report.startup = startup;
+		report.elapsed = clock::now() - start;
+		report.cpuTime = ProcessCpuTime() - cpuStart;
+
+		report.games = games.load();
+		report.messagesSent = messagesSent.load();
+		report.messagesReceived = messagesReceived.load();
+		report.errors = errors.load();
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			report.firstError = firstError;
+		}
+		for (size_t i = 0; i < OPERATION_COUNT; i++)
+			report.latency.emplace_back(OPERATION_NAMES[i], latency[i].GetSnapshot());
+
+		players.clear();
+		return report;
+	}
+}
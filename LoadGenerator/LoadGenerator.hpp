@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Connection.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace loadgen
+{
+	/*
+	*    
+	*/
+	enum class LobbyMode
+	{
+		//   ,      ,    
+		Poll,
+
+		//     ,       OnOffer
+		Subscribe,
+	};
+
+	struct LoadOptions
+	{
+		//  
+		std::string url = "127.0.0.1";
+		std::string port = conn::WebSocketAsyncGameConnection::DEFAULT_PORT;
+
+		//  ,    :   
+		size_t players = 1000;
+
+		//  ConnectionContext,    
+		size_t threads = std::thread::hardware_concurrency();
+
+		//        , 0 -  
+		size_t connectConcurrency = 256;
+
+		std::chrono::seconds duration{ 30 };
+
+		LobbyMode lobby = LobbyMode::Subscribe;
+
+		//       Poll
+		std::chrono::milliseconds pollInterval{ 100 };
+
+		//        ,    ;  0    
+		double chatRate = 10;
+
+		//       
+		size_t messagesPerGame = 20;
+
+		conn::ConnectionOptions connection;
+	};
+
+	/*
+	*  
+	*     ,    ,   
+	*/
+	struct LoadReport
+	{
+		size_t players = 0;
+		//      
+		std::chrono::duration<double> startup{ 0 };
+		std::chrono::duration<double> elapsed{ 0 };
+		std::chrono::duration<double> cpuTime{ 0 };
+
+		uint64_t games = 0;
+		uint64_t messagesSent = 0;
+		uint64_t messagesReceived = 0;
+		uint64_t errors = 0;
+		std::string firstError;
+
+		//        
+		std::vector<std::pair<std::string, conn::LatencyHistogram::Snapshot>> latency;
+	};
+
+	/*
+	*  : N    ConnectionContext ,  ,
+	*       ,    
+	*   -    strand,        strand
+	*/
+	class LoadGenerator
+	{
+		struct SimulatedPlayer;
+
+		enum Operation
+		{
+			//        websocket
+			Connect,
+			Register,
+			List,
+			Offer,
+			//      
+			Match,
+			MessageAck,
+			//       
+			MessageDelivery,
+			EndGame,
+			OPERATION_COUNT
+		};
+		static const char* const OPERATION_NAMES[OPERATION_COUNT];
+
+		const LoadOptions options;
+		std::shared_ptr<conn::ConnectionContext> context;
+
+		std::array<conn::LatencyHistogram, OPERATION_COUNT> latency;
+		std::atomic<uint64_t> games{ 0 };
+		std::atomic<uint64_t> messagesSent{ 0 };
+		std::atomic<uint64_t> messagesReceived{ 0 };
+		std::atomic<uint64_t> errors{ 0 };
+		std::mutex errorMutex;
+		std::string firstError;
+
+		std::atomic<bool> stopping{ false };
+		std::atomic<size_t> running{ 0 };
+
+		void Record(Operation operation, std::chrono::steady_clock::time_point start);
+		void RecordError(std::exception const& e);
+
+		//    ,    ;     
+		conn::net::awaitable<void> ConnectPlayers(std::vector<std::unique_ptr<SimulatedPlayer>>& players, std::atomic<size_t>& next);
+		void Subscribe(SimulatedPlayer& player);
+
+		conn::net::awaitable<void> Play(SimulatedPlayer& player);
+		conn::net::awaitable<bool> FindOpponent(SimulatedPlayer& player);
+		conn::net::awaitable<void> Chat(SimulatedPlayer& player);
+		//   ,    ;  false,   
+		template <typename Condition>
+		conn::net::awaitable<bool> WaitUntil(SimulatedPlayer& player, Condition condition);
+	public:
+		explicit LoadGenerator(LoadOptions options);
+		~LoadGenerator();
+
+		LoadGenerator(LoadGenerator const&) = delete;
+		LoadGenerator& operator= (LoadGenerator const&) = delete;
+
+		/*
+		*    ,   options.duration     
+		*      ,   
+		*/
+		LoadReport Run();
+	};
+}
@@ -0,0 +1,167 @@
+#include "LoadGenerator.hpp"
+#include "Benchmark/LocalGameServer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <optional>
+
+using namespace loadgen;
+
+static void PrintUsage()
+{
+	std::cout <<
+		"Usage: LoadGenerator [options]\n"
+		"  --url <address>        server address, 127.0.0.1 by default\n"
+		"  --port <port>          server port, a local stand-in server is started when omitted\n"
+		"  --players <count>      simulated players, 1000 by default\n"
+		"  --threads <count>      connection context threads, one per core by default\n"
+		"  --connect-concurrency <count>\n"
+		"                         players connecting at the same time, 0 - all at once, 256 by default\n"
+		"  --duration <seconds>   load duration, 30 by default\n"
+		"  --lobby poll|subscribe how players find an opponent, subscribe by default\n"
+		"  --poll-interval <ms>   list request interval in the poll mode, 100 by default\n"
+		"  --rate <messages/s>    chat rate of one player, 0 - as fast as possible, 10 by default\n"
+		"  --messages <count>     messages from each player per game, 20 by default\n"
+		"  --request-timeout <ms> time to wait for a server reply, 0 - no limit, 0 by default\n"
+		"  --binary               offer the binary protocol\n"
+		"  --coalesce             coalesce outgoing requests\n";
+}
+
+//    ,     
+static std::optional<LoadOptions> ParseArguments(int argc, char* argv[], bool& localServer)
+{
+	LoadOptions options;
+	localServer = true;
+
+	// the generator measures every operation itself, the connection histograms would only take memory of every player
+	options.connection.latencyHistograms = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string name = argv[i];
+		if (name == "--binary")
+		{
+			options.connection.preferBinaryProtocol = true;
+			continue;
+		}
+		if (name == "--coalesce")
+		{
+			options.connection.coalescing.enabled = true;
+			continue;
+		}
+
+		if (i + 1 == argc)
+			return std::nullopt;
+		std::string value = argv[++i];
+
+		try
+		{
+			if (name == "--url")
+				options.url = value;
+			else if (name == "--port")
+			{
+				options.port = value;
+				localServer = false;
+			}
+			else if (name == "--players")
+				options.players = std::stoul(value);
+			else if (name == "--threads")
+				options.threads = std::stoul(value);
+			else if (name == "--connect-concurrency")
+				options.connectConcurrency = std::stoul(value);
+			else if (name == "--duration")
+				options.duration = std::chrono::seconds(std::stol(value));
+			else if (name == "--lobby" && (value == "poll" || value == "subscribe"))
+				options.lobby = value == "poll" ? LobbyMode::Poll : LobbyMode::Subscribe;
+			else if (name == "--poll-interval")
+				options.pollInterval = std::chrono::milliseconds(std::stol(value));
+			else if (name == "--rate")
+				options.chatRate = std::stod(value);
+			else if (name == "--messages")
+				options.messagesPerGame = std::stoul(value);
+			else if (name == "--request-timeout")
+				options.connection.requestTimeout = std::chrono::milliseconds(std::stol(value));
+			else
+				return std::nullopt;
+		}
+		catch (std::logic_error const&)
+		{
+			return std::nullopt;
+		}
+	}
+
+	if (options.players < 2)
+		return std::nullopt;
+	return options;
+}
+
+static double Microseconds(std::chrono::nanoseconds duration)
+{
+	return duration.count() / 1000.0;
+}
+
+static void PrintReport(LoadOptions const& options, LoadReport const& report)
+{
+	double seconds = report.elapsed.count();
+
+	std::printf("%zu players, %zu threads, %s protocol, %s lobby, %.1f s\n", report.players, options.threads,
+		options.connection.preferBinaryProtocol ? "binary" : "text", options.lobby == LobbyMode::Poll ? "poll" : "subscribe", seconds);
+	std::printf("started in %.2f s, %zu players connecting at a time\n\n", report.startup.count(),
+		options.connectConcurrency == 0 ? report.players : (std::min)(options.connectConcurrency, report.players));
+
+	std::printf("%-20s %12llu %12.1f/s\n", "games", static_cast<unsigned long long>(report.games), report.games / seconds);
+	std::printf("%-20s %12llu %12.1f/s\n", "messages sent", static_cast<unsigned long long>(report.messagesSent), report.messagesSent / seconds);
+	std::printf("%-20s %12llu %12.1f/s\n", "messages received", static_cast<unsigned long long>(report.messagesReceived), report.messagesReceived / seconds);
+	std::printf("%-20s %12llu\n", "errors", static_cast<unsigned long long>(report.errors));
+	if (!report.firstError.empty())
+		std::printf("%-20s %s\n", "first error", report.firstError.c_str());
+
+	double cores = report.cpuTime.count() / seconds;
+	std::printf("%-20s %12.2f s %10.2f cores %10.0f messages per core-second\n\n", "cpu", report.cpuTime.count(), cores,
+		report.cpuTime.count() > 0 ? (report.messagesSent + report.messagesReceived) / report.cpuTime.count() : 0.0);
+
+	std::printf("%-20s %10s %12s %12s %12s %12s\n", "operation, us", "count", "p50", "p99", "p999", "max");
+	for (auto& [name, latency] : report.latency)
+	{
+		if (latency.count == 0)
+			continue;
+		std::printf("%-20s %10llu %12.1f %12.1f %12.1f %12.1f\n", name.c_str(), static_cast<unsigned long long>(latency.count),
+			Microseconds(latency.Percentile(0.5)), Microseconds(latency.Percentile(0.99)),
+			Microseconds(latency.Percentile(0.999)), Microseconds(latency.Max()));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool localServer = true;
+	std::optional<LoadOptions> options = ParseArguments(argc, argv, localServer);
+	if (!options)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		// the local server handles every connection in one thread, so it saturates long before a real server
+		std::optional<bench::LocalGameServer> server;
+		if (localServer)
+		{
+			server.emplace();
+			options->url = "127.0.0.1";
+			options->port = server->GetPort();
+		}
+
+		LoadGenerator generator(*options);
+		LoadReport report = generator.Run();
+		PrintReport(*options, report);
+		return report.errors == 0 ? 0 : 2;
+	}
+	catch (std::exception const& e)
+	{
+		std::cerr << "Load generator failed: " << e.what() << "\n";
+		return 1;
+	}
+}
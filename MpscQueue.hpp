@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <memory_resource>
+
+namespace conn
+{
+	/*
+	*  lock-free       
+	* Push        , TryPop     
+	*     
+	*     memoryResource  Push    TryPop,        ,
+	*  RecyclingPool,   
+	*/
+	template <typename T>
+	class MpscQueue
+	{
+		struct Node
+		{
+			std::atomic<Node*> next{ nullptr };
+			std::optional<T> value;
+		};
+
+		std::pmr::polymorphic_allocator<Node> allocator;
+
+		// producers append after head, the consumer reads after tail
+		alignas(64) std::atomic<Node*> head;
+		alignas(64) Node* tail;
+	public:
+		explicit MpscQueue(std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource()) : allocator(memoryResource)
+		{
+			Node* stub = allocator.template new_object<Node>();
+			head.store(stub, std::memory_order_relaxed);
+			tail = stub;
+		}
+		~MpscQueue()
+		{
+			while (tail)
+			{
+				Node* next = tail->next.load(std::memory_order_relaxed);
+				allocator.delete_object(tail);
+				tail = next;
+			}
+		}
+
+		MpscQueue(MpscQueue const&) = delete;
+		MpscQueue& operator= (MpscQueue const&) = delete;
+
+		void Push(T value)
+		{
+			Node* node = allocator.template new_object<Node>();
+			node->value.emplace(std::move(value));
+
+			Node* prev = head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		//   ,   
+		std::optional<T> TryPop()
+		{
+			Node* next = tail->next.load(std::memory_order_acquire);
+			if (!next)
+				return std::nullopt;
+
+			// move construction keeps the allocator of the value
+			std::optional<T> value(std::move(next->value));
+			next->value.reset();
+
+			// next becomes the new stub
+			allocator.delete_object(tail);
+			tail = next;
+			return value;
+		}
+	};
+}
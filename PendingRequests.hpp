@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace conn
+{
+	/*
+	*         
+	*    ,     ID   ,       
+	*      ,    ,
+	*  ,       ,        
+	*        O(1)   
+	*  
+	*/
+	template <typename Id, typename Handler>
+	class PendingRequests
+	{
+		struct Slot
+		{
+			bool used = false;
+			Id id{};
+			Handler handler;
+		};
+
+		std::vector<Slot> slots;
+		size_t mask;
+		size_t capacity;
+		size_t count = 0;
+
+		size_t Home(Id id) const
+		{
+			return static_cast<size_t>(id) & mask;
+		}
+		size_t Next(size_t index) const
+		{
+			return (index + 1) & mask;
+		}
+
+		//     slots.size(),     ID   
+		size_t Find(Id id) const
+		{
+			for (size_t i = Home(id); slots[i].used; i = Next(i))
+			{
+				if (slots[i].id == id)
+					return i;
+			}
+			return slots.size();
+		}
+
+		//          ,       
+		void Erase(size_t hole)
+		{
+			slots[hole].handler = Handler();
+			slots[hole].used = false;
+			--count;
+
+			for (size_t i = Next(hole); slots[i].used; i = Next(i))
+			{
+				// the request may move back only while the hole stays between its home slot and its slot
+				if (((i - Home(slots[i].id)) & mask) < ((i - hole) & mask))
+					continue;
+
+				slots[hole] = std::move(slots[i]);
+				slots[i].handler = Handler();
+				slots[i].used = false;
+				hole = i;
+			}
+		}
+	public:
+		// capacity -    ,   -     2 * capacity
+		explicit PendingRequests(size_t capacity) : capacity(capacity)
+		{
+			size_t size = 2;
+			while (size < 2 * capacity)
+				size <<= 1;
+
+			slots.resize(size);
+			mask = size - 1;
+		}
+
+		/*
+		*   
+		*  false,     capacity 
+		*/
+		bool Insert(Id id, Handler handler)
+		{
+			if (count == capacity)
+				return false;
+
+			size_t i = Home(id);
+			while (slots[i].used)
+				i = Next(i);
+
+			slots[i].used = true;
+			slots[i].id = id;
+			slots[i].handler = std::move(handler);
+			++count;
+			return true;
+		}
+
+		/*
+		*      
+		*  false,     ID   
+		*/
+		bool Extract(Id id, Handler& handler)
+		{
+			size_t i = Find(id);
+			if (i == slots.size())
+				return false;
+
+			handler = std::move(slots[i].handler);
+			Erase(i);
+			return true;
+		}
+
+		/*
+		*    ,  ID  predicate  true
+		*   ,     ,   
+		*/
+		template <typename Predicate>
+		std::vector<Handler> ExtractIf(Predicate predicate)
+		{
+			// the ids are collected first, because erasing moves the following requests of a chain back
+			std::vector<Id> ids;
+			for (Slot const& slot : slots)
+			{
+				if (slot.used && predicate(slot.id))
+					ids.push_back(slot.id);
+			}
+
+			std::vector<Handler> extracted;
+			extracted.reserve(ids.size());
+			for (Id id : ids)
+			{
+				size_t i = Find(id);
+				extracted.push_back(std::move(slots[i].handler));
+				Erase(i);
+			}
+			return extracted;
+		}
+
+		size_t Size() const
+		{
+			return count;
+		}
+		size_t Capacity() const
+		{
+			return capacity;
+		}
+	};
+}
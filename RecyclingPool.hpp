@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+namespace conn
+{
+	/*
+	*     ,        
+	*     ,      
+	* ,   ,   lock-free         
+	*      ,      
+	*/
+	class RecyclingPool : public std::pmr::memory_resource
+	{
+		// the header is written into the freed block itself, so smaller blocks are rounded up to it
+		struct FreedBlock
+		{
+			FreedBlock* next;
+			std::size_t bytes;
+			std::size_t alignment;
+		};
+
+		std::pmr::unsynchronized_pool_resource pool;
+		alignas(64) std::atomic<FreedBlock*> freed{ nullptr };
+
+		static std::size_t BlockSize(std::size_t bytes)
+		{
+			return (std::max)(bytes, sizeof(FreedBlock));
+		}
+		static std::size_t BlockAlignment(std::size_t alignment)
+		{
+			return (std::max)(alignment, alignof(FreedBlock));
+		}
+
+		//     ,    
+		void Recycle()
+		{
+			FreedBlock* block = freed.exchange(nullptr, std::memory_order_acquire);
+			while (block)
+			{
+				FreedBlock* next = block->next;
+				pool.deallocate(block, block->bytes, block->alignment);
+				block = next;
+			}
+		}
+	protected:
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override
+		{
+			// the whole batch is taken by one exchange, the list is empty most of the time
+			if (freed.load(std::memory_order_relaxed))
+				Recycle();
+			return pool.allocate(BlockSize(bytes), BlockAlignment(alignment));
+		}
+		void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+		{
+			FreedBlock* block = new (p) FreedBlock{ freed.load(std::memory_order_relaxed), BlockSize(bytes), BlockAlignment(alignment) };
+			while (!freed.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+			{
+			}
+		}
+		bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+		{
+			return this == &other;
+		}
+	public:
+		RecyclingPool() = default;
+
+		RecyclingPool(RecyclingPool const&) = delete;
+		RecyclingPool& operator= (RecyclingPool const&) = delete;
+	};
+}
@@ -0,0 +1,102 @@
+#include "Tests.hpp"
+#include "Connection.hpp"
+#include "Benchmark/LocalGameServer.hpp"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using namespace conn;
+
+namespace tests
+{
+	// ,         
+	static bench::LocalGameServerOptions SilentServer()
+	{
+		bench::LocalGameServerOptions options;
+		options.replyLoss = 1;
+		return options;
+	}
+
+	static CallOptions Timeout(std::chrono::milliseconds timeout)
+	{
+		CallOptions call;
+		call.timeout = timeout;
+		return call;
+	}
+
+	//     TimeoutException    
+	static void TestCallTimeout()
+	{
+		bench::LocalGameServer server(SilentServer());
+		auto context = std::make_shared<ConnectionContext>(1);
+		WebSocketAsyncGameConnection alice(context, "127.0.0.1", server.GetPort());
+		WebSocketAsyncGameConnection bob(context, "127.0.0.1", server.GetPort());
+		alice.Register("alice");
+		bob.Register("bob");
+
+		for (int i = 0; i < 3; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			CHECK_THROWS(alice.SendOffer(bob.GetID(), Timeout(std::chrono::milliseconds(50))), TimeoutException);
+			CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+		}
+	}
+
+	//     ConnectionOptions::requestTimeout
+	static void TestConnectionTimeout()
+	{
+		bench::LocalGameServer server(SilentServer());
+		auto context = std::make_shared<ConnectionContext>(1);
+		ConnectionOptions options;
+		options.requestTimeout = std::chrono::milliseconds(50);
+		WebSocketAsyncGameConnection alice(context, "127.0.0.1", server.GetPort(), options);
+		WebSocketAsyncGameConnection bob(context, "127.0.0.1", server.GetPort());
+		alice.Register("alice");
+		bob.Register("bob");
+
+		CHECK_THROWS(alice.SendOffer(bob.GetID()), TimeoutException);
+	}
+
+	//     CancelledException,     - 
+	static void TestCancellation()
+	{
+		bench::LocalGameServer server(SilentServer());
+		auto context = std::make_shared<ConnectionContext>(1);
+		WebSocketAsyncGameConnection alice(context, "127.0.0.1", server.GetPort());
+		WebSocketAsyncGameConnection bob(context, "127.0.0.1", server.GetPort());
+		alice.Register("alice");
+		bob.Register("bob");
+
+		CancellationSource source;
+		CallOptions call;
+		call.cancellation = source.GetToken();
+		std::thread canceller([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			source.Cancel();
+		});
+		CHECK_THROWS(alice.SendOffer(bob.GetID(), call), CancelledException);
+		canceller.join();
+
+		CHECK_THROWS(alice.SendOffer(bob.GetID(), call), CancelledException);
+	}
+
+	//         
+	static void TestRegisterTimeoutRequired()
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		ConnectionOptions options;
+		options.reconnect.enabled = true;
+		options.reconnect.registerTimeout = std::chrono::milliseconds(0);
+		CHECK_THROWS(WebSocketAsyncGameConnection(context, "127.0.0.1", server.GetPort(), options), ConnectionException);
+	}
+
+	void RunDeadlineTests()
+	{
+		TestCallTimeout();
+		TestConnectionTimeout();
+		TestCancellation();
+		TestRegisterTimeoutRequired();
+	}
+}
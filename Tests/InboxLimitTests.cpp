@@ -0,0 +1,142 @@
+#include "Tests.hpp"
+#include "Connection.hpp"
+#include "Benchmark/LocalGameServer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace conn;
+
+namespace tests
+{
+	static const std::vector<String> SENT = { "m1", "m2", "m3", "m4", "m5", "m6" };
+
+	static ConnectionOptions LimitedMessages(size_t maxMessages, OverflowPolicy policy)
+	{
+		ConnectionOptions options;
+		options.inbox.maxMessages = maxMessages;
+		options.inbox.messagePolicy = policy;
+		return options;
+	}
+
+	static void StartGame(WebSocketAsyncGameConnection& a, WebSocketAsyncGameConnection& b)
+	{
+		a.Register("alice");
+		b.Register("bob");
+		a.SendOffer(b.GetID());
+		b.SendOffer(a.GetID());
+		CHECK(WaitUntil([&]() {
+			return a.GetState() == GameConnection::State::InGame && b.GetState() == GameConnection::State::InGame;
+		}));
+	}
+
+	static std::vector<String> Texts(std::vector<Message> const& messages)
+	{
+		std::vector<String> texts;
+		for (auto& message : messages)
+			texts.push_back(message.message);
+		return texts;
+	}
+
+	//  OnMessage   ,        maxMessages
+	static void TestDropMessages(OverflowPolicy policy, std::vector<String> const& kept)
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		WebSocketAsyncGameConnection alice(context, "127.0.0.1", server.GetPort(), LimitedMessages(3, policy));
+		WebSocketAsyncGameConnection bob(context, "127.0.0.1", server.GetPort());
+
+		std::atomic<size_t> notified{ 0 };
+		alice.OnMessage([&](Message const&) { notified++; });
+		StartGame(alice, bob);
+
+		for (auto& message : SENT)
+			bob.SendMessage(message);
+		CHECK(WaitUntil([&]() { return notified == SENT.size(); }));
+
+		CHECK(Texts(alice.GetMessages()) == kept);
+		ConnectionStats stats = alice.GetStats();
+		CHECK(stats.droppedMessages == SENT.size() - kept.size());
+		CHECK(stats.storedMessagesPeak == kept.size());
+	}
+
+	//    maxMessages     RemoveMessage,   
+	static void TestPauseReading()
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		WebSocketAsyncGameConnection alice(context, "127.0.0.1", server.GetPort(), LimitedMessages(2, OverflowPolicy::PauseReading));
+		WebSocketAsyncGameConnection bob(context, "127.0.0.1", server.GetPort());
+		StartGame(alice, bob);
+
+		bob.SendMessages(SENT);
+		CHECK(WaitUntil([&]() { return alice.GetStats().readPauses == 1; }));
+
+		// nothing is read while paused, so the list stays at the limit
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		CHECK(alice.GetMessages().size() == 2);
+
+		std::vector<String> received;
+		CHECK(WaitUntil([&]() {
+			for (auto& message : alice.GetMessages())
+			{
+				received.push_back(message.message);
+				alice.RemoveMessage(message.messageId);
+			}
+			return received.size() >= SENT.size();
+		}));
+		CHECK(received == SENT);
+
+		ConnectionStats stats = alice.GetStats();
+		CHECK(stats.droppedMessages == 0);
+		CHECK(stats.storedMessagesPeak == 2);
+	}
+
+	//       
+	static void TestDropOffers(OverflowPolicy policy, bool keepFirst)
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		ConnectionOptions options;
+		options.inbox.maxOffers = 1;
+		options.inbox.offerPolicy = policy;
+		WebSocketAsyncGameConnection alice(context, "127.0.0.1", server.GetPort(), options);
+		WebSocketAsyncGameConnection bob(context, "127.0.0.1", server.GetPort());
+		WebSocketAsyncGameConnection carol(context, "127.0.0.1", server.GetPort());
+		alice.Register("alice");
+		bob.Register("bob");
+		carol.Register("carol");
+
+		bob.SendOffer(alice.GetID());
+		carol.SendOffer(alice.GetID());
+		CHECK(WaitUntil([&]() { return alice.GetStats().droppedOffers == 1; }));
+
+		std::vector<PlayerID> offers = alice.GetOffers();
+		CHECK(offers.size() == 1);
+		CHECK(offers[0] == (keepFirst ? bob.GetID() : carol.GetID()));
+	}
+
+	//    ,    -  
+	static void TestOfferPauseRejected()
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		ConnectionOptions options;
+		options.inbox.maxOffers = 1;
+		options.inbox.offerPolicy = OverflowPolicy::PauseReading;
+		CHECK_THROWS(WebSocketAsyncGameConnection(context, "127.0.0.1", server.GetPort(), options), ConnectionException);
+	}
+
+	void RunInboxLimitTests()
+	{
+		TestDropMessages(OverflowPolicy::DropOldest, { "m4", "m5", "m6" });
+		TestDropMessages(OverflowPolicy::DropNewest, { "m1", "m2", "m3" });
+		TestPauseReading();
+		TestDropOffers(OverflowPolicy::DropOldest, false);
+		TestDropOffers(OverflowPolicy::DropNewest, true);
+		TestOfferPauseRejected();
+	}
+}
@@ -0,0 +1,60 @@
+#include "Tests.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <string>
+
+namespace
+{
+	struct Suite
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	const Suite SUITES[] = {
+		{ "validation", tests::RunValidationTests },
+		{ "pending-requests", tests::RunPendingRequestsTests },
+		{ "reconnect", tests::RunReconnectTests },
+		{ "deadlines", tests::RunDeadlineTests },
+		{ "inbox-limit", tests::RunInboxLimitTests },
+	};
+
+	bool Run(Suite const& suite)
+	{
+		try
+		{
+			suite.run();
+			std::printf("%-32s OK\n", suite.name);
+			return true;
+		}
+		catch (std::exception const& e)
+		{
+			std::printf("%-32s FAILED: %s\n", suite.name, e.what());
+			return false;
+		}
+	}
+}
+
+// Tests [suite] -     ,   -   
+int main(int argc, char* argv[])
+{
+	if (argc == 2)
+	{
+		for (auto& suite : SUITES)
+		{
+			if (std::string(argv[1]) == suite.name)
+				return Run(suite) ? 0 : 1;
+		}
+		std::printf("Unknown test suite: %s\n", argv[1]);
+		return 1;
+	}
+
+	int failed = 0;
+	for (auto& suite : SUITES)
+	{
+		if (!Run(suite))
+			failed++;
+	}
+	return failed;
+}
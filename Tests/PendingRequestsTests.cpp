@@ -0,0 +1,159 @@
+#include "Tests.hpp"
+#include "PendingRequests.hpp"
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace conn;
+
+namespace tests
+{
+	typedef PendingRequests<uint64_t, int> Table;
+
+	//      ,    ID    
+	static void TestLostReply()
+	{
+		Table table(4);
+		CHECK(table.Insert(0, -1));
+
+		int handler = 0;
+		for (uint64_t id = 1; id <= 10000; id++)
+		{
+			CHECK(table.Insert(id, static_cast<int>(id)));
+			CHECK(table.Extract(id, handler));
+			CHECK(handler == static_cast<int>(id));
+		}
+		CHECK(table.Size() == 1);
+		CHECK(table.Extract(0, handler));
+		CHECK(handler == -1);
+	}
+
+	//     capacity  
+	static void TestExhaustion()
+	{
+		Table table(4);
+		CHECK(table.Capacity() == 4);
+		for (uint64_t id = 100; id < 104; id++)
+			CHECK(table.Insert(id, static_cast<int>(id)));
+		CHECK(!table.Insert(104, 104));
+		CHECK(table.Size() == 4);
+
+		int handler = 0;
+		CHECK(table.Extract(101, handler));
+		CHECK(table.Insert(104, 104));
+		CHECK(!table.Insert(105, 105));
+
+		for (uint64_t id : { 100, 102, 103, 104 })
+		{
+			CHECK(table.Extract(id, handler));
+			CHECK(handler == static_cast<int>(id));
+		}
+		CHECK(table.Size() == 0);
+		CHECK(!table.Extract(101, handler));
+	}
+
+	// ID          ,        
+	static void TestCollisions()
+	{
+		Table table(4);
+		int handler = 0;
+		for (uint64_t first : { 0, 7 })
+		{
+			CHECK(table.Insert(first, 1));
+			CHECK(table.Insert(first + 8, 2));
+			CHECK(table.Insert(first + 16, 3));
+			CHECK(table.Insert(first + 1, 4));
+
+			CHECK(table.Extract(first + 8, handler) && handler == 2);
+			CHECK(!table.Extract(first + 24, handler));
+			CHECK(table.Extract(first + 1, handler) && handler == 4);
+			CHECK(table.Extract(first, handler) && handler == 1);
+			CHECK(table.Extract(first + 16, handler) && handler == 3);
+			CHECK(table.Size() == 0);
+		}
+	}
+
+	// ExtractIf    ,  - ,      
+	static void TestExtractIf()
+	{
+		Table table(8);
+		for (uint64_t id : { 0, 16, 32, 1, 17, 5 })
+			CHECK(table.Insert(id, static_cast<int>(id)));
+
+		std::vector<int> extracted = table.ExtractIf([](uint64_t id) { return id % 16 == 0; });
+		CHECK(extracted.size() == 3);
+		CHECK(table.Size() == 3);
+
+		int handler = 0;
+		CHECK(!table.Extract(16, handler));
+		for (uint64_t id : { 1, 17, 5 })
+		{
+			CHECK(table.Extract(id, handler));
+			CHECK(handler == static_cast<int>(id));
+		}
+		CHECK(table.ExtractIf([](uint64_t) { return true; }).empty());
+	}
+
+	//        ,   std::map
+	static void TestAgainstMap()
+	{
+		Table table(64);
+		std::map<uint64_t, int> expected;
+		std::mt19937 random(12345);
+		uint64_t nextId = 0;
+
+		for (int step = 0; step < 200000; step++)
+		{
+			int handler = 0;
+			switch (random() % 3)
+			{
+			case 0:
+			{
+				uint64_t id = nextId++;
+				bool inserted = table.Insert(id, step);
+				CHECK(inserted == (expected.size() < 64));
+				if (inserted)
+					expected[id] = step;
+				break;
+			}
+			case 1:
+			{
+				if (expected.empty())
+					break;
+				// a random pending request, so some requests stay pending for a long time
+				auto it = expected.begin();
+				std::advance(it, random() % expected.size());
+				CHECK(table.Extract(it->first, handler));
+				CHECK(handler == it->second);
+				expected.erase(it);
+				break;
+			}
+			default:
+			{
+				uint64_t id = nextId ? random() % nextId : 0;
+				bool pending = expected.count(id) != 0;
+				CHECK(table.Extract(id, handler) == pending);
+				if (pending)
+				{
+					CHECK(handler == expected[id]);
+					expected.erase(id);
+				}
+				break;
+			}
+			}
+			CHECK(table.Size() == expected.size());
+		}
+	}
+
+	void RunPendingRequestsTests()
+	{
+		TestLostReply();
+		TestExhaustion();
+		TestCollisions();
+		TestExtractIf();
+		TestAgainstMap();
+	}
+}
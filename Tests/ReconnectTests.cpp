@@ -0,0 +1,114 @@
+#include "Tests.hpp"
+#include "Connection.hpp"
+#include "Benchmark/LocalGameServer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+using namespace conn;
+
+namespace tests
+{
+	static ConnectionOptions ReconnectOptions()
+	{
+		ConnectionOptions options;
+		options.reconnect.enabled = true;
+		options.reconnect.initialDelay = std::chrono::milliseconds(5);
+		return options;
+	}
+
+	//      
+	static bool RequestFails(WebSocketAsyncGameConnection& connection)
+	{
+		try
+		{
+			connection.GetPlayers();
+			return false;
+		}
+		catch (ConnectionException const&)
+		{
+			return true;
+		}
+	}
+
+	//         ID,    
+	static void TestReregistration()
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		WebSocketAsyncGameConnection connection(context, "127.0.0.1", server.GetPort(), ReconnectOptions());
+		connection.Register("alice");
+		PlayerID previous = connection.GetID();
+
+		for (uint64_t drops = 1; drops <= 3; drops++)
+		{
+			server.DropConnections();
+			CHECK(WaitUntil([&]() { return connection.GetStats().reconnects == drops; }));
+			CHECK(connection.GetState() == GameConnection::State::Searching);
+
+			PlayerID id = connection.GetID();
+			CHECK(!id.Empty());
+			CHECK(id != previous);
+			previous = id;
+
+			connection.GetPlayers();
+		}
+		CHECK(connection.GetStats().reconnectTime.count == 3);
+	}
+
+	//        ,        
+	static void TestGameEndsOnReconnect()
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(2);
+		WebSocketAsyncGameConnection a(context, "127.0.0.1", server.GetPort(), ReconnectOptions());
+		WebSocketAsyncGameConnection b(context, "127.0.0.1", server.GetPort(), ReconnectOptions());
+
+		std::atomic<int> ended{ 0 };
+		a.OnGameEnded([&]() { ended++; });
+		b.OnGameEnded([&]() { ended++; });
+
+		a.Register("alice");
+		b.Register("bob");
+		a.SendOffer(b.GetID());
+		b.SendOffer(a.GetID());
+		CHECK(WaitUntil([&]() {
+			return a.GetState() == GameConnection::State::InGame && b.GetState() == GameConnection::State::InGame;
+		}));
+
+		server.DropConnections();
+		CHECK(WaitUntil([&]() { return a.GetStats().reconnects == 1 && b.GetStats().reconnects == 1; }));
+		CHECK(WaitUntil([&]() { return ended == 2; }));
+		CHECK(a.GetState() == GameConnection::State::Searching);
+		CHECK(b.GetState() == GameConnection::State::Searching);
+
+		// the new ids are known to the server, so a new game starts as usual
+		a.SendOffer(b.GetID());
+		b.SendOffer(a.GetID());
+		CHECK(WaitUntil([&]() {
+			return a.GetState() == GameConnection::State::InGame && b.GetState() == GameConnection::State::InGame;
+		}));
+	}
+
+	//      ,     
+	static void TestReconnectDisabled()
+	{
+		bench::LocalGameServer server;
+		auto context = std::make_shared<ConnectionContext>(1);
+		WebSocketAsyncGameConnection connection(context, "127.0.0.1", server.GetPort());
+		connection.Register("alice");
+
+		server.DropConnections();
+		CHECK(RequestFails(connection));
+		CHECK(RequestFails(connection));
+		CHECK(connection.GetStats().reconnects == 0);
+	}
+
+	void RunReconnectTests()
+	{
+		TestReregistration();
+		TestGameEndsOnReconnect();
+		TestReconnectDisabled();
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace tests
+{
+	//   ,   
+	class CheckFailed : public std::runtime_error
+	{
+	public:
+		CheckFailed(const std::string& msg) : std::runtime_error(msg) {}
+	};
+
+	//  CheckFailed      ,    
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+			throw ::tests::CheckFailed(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " + #condition); \
+	} while (false)
+
+	//  CheckFailed,       exception
+#define CHECK_THROWS(expression, exception) \
+	do \
+	{ \
+		bool thrown = false; \
+		try \
+		{ \
+			expression; \
+		} \
+		catch (exception const&) \
+		{ \
+			thrown = true; \
+		} \
+		if (!thrown) \
+			throw ::tests::CheckFailed(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " + #expression + " does not throw " + #exception); \
+	} while (false)
+
+	//   ,     ,  false,      timeout
+	template <typename Condition>
+	bool WaitUntil(Condition condition, std::chrono::seconds timeout = std::chrono::seconds(10))
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!condition())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	void RunValidationTests();
+	void RunPendingRequestsTests();
+	void RunReconnectTests();
+	void RunDeadlineTests();
+	void RunInboxLimitTests();
+}
@@ -0,0 +1,89 @@
+#include "Tests.hpp"
+#include "Connection.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace conn;
+
+namespace tests
+{
+	// the per-character loop GameConnection::IsValidMessage used before the vector kernels
+	static bool IsValidMessageReference(std::string_view message)
+	{
+		for (auto& c : message)
+		{
+			if ((c >= '' && c <= '') || (c >= '' && c <= '') ||
+				(c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+				(c >= '0' && c <= '9') ||
+				c == ' ' || c == '-' || c == '_')
+				continue;
+			return false;
+		}
+		return true;
+	}
+
+	//    :   AVX2  
+	static const size_t MAX_LENGTH = 80;
+
+	static String MakeValidMessage(size_t length)
+	{
+		const std::string alphabet = " hello-world_123  ";
+
+		String message;
+		while (message.size() < length)
+			message += alphabet[message.size() % alphabet.size()];
+		return message;
+	}
+
+	void RunValidationTests()
+	{
+		// every byte value at every position of every length around the 16 and 32 byte vector widths
+		for (size_t length = 0; length <= MAX_LENGTH; length++)
+		{
+			String valid = MakeValidMessage(length);
+			CHECK(IsValidMessageReference(valid));
+			CHECK(GameConnection::IsValidMessage(valid));
+
+			std::vector<String> batch;
+			std::vector<bool> expected;
+			for (size_t position = 0; position < length; position++)
+			{
+				for (int byte = 0; byte < 256; byte++)
+				{
+					String message = valid;
+					message[position] = static_cast<char>(byte);
+
+					bool reference = IsValidMessageReference(message);
+					CHECK(GameConnection::IsValidMessage(message) == reference);
+					batch.push_back(std::move(message));
+					expected.push_back(reference);
+				}
+			}
+			CHECK(GameConnection::AreValidMessages(batch) == expected);
+		}
+
+		// the kernels load unaligned data, so the same checks hold at every offset inside a vector
+		String buffer = MakeValidMessage(MAX_LENGTH + 32);
+		for (size_t offset = 0; offset < 32; offset++)
+		{
+			for (size_t length = 0; length <= MAX_LENGTH; length++)
+			{
+				std::string_view message(buffer.data() + offset, length);
+				CHECK(GameConnection::IsValidMessage(message));
+
+				for (size_t position = 0; position < length; position++)
+				{
+					char saved = buffer[offset + position];
+					for (char invalid : { '\0', '/', ':', '@', '[', '`', '{', '\x7F', '\x80', '\xA8', '\xB8', '\xBF' })
+					{
+						buffer[offset + position] = invalid;
+						CHECK(!GameConnection::IsValidMessage(message));
+					}
+					buffer[offset + position] = saved;
+				}
+			}
+		}
+	}
+}
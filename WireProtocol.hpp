@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace conn
+{
+	/*
+	*     ,        websocket
+	*       websocket       
+	*    varint (7   ,   ),  -  varint    
+	*
+	*  :        < > <varint ID > [< >]
+	*  :    Batch <varint > (<   >)...
+	*   :       Response <varint ID > < Status> [<   "error: ">]
+	*  :        List <varint > (< ID> < >)...
+	*  :     < > [< >]
+	*/
+	namespace wire
+	{
+		//  ,      
+		inline constexpr std::string_view BINARY_SUBPROTOCOL = "game.binary.v1";
+
+		enum class Opcode : uint8_t
+		{
+			// v commands from the player v
+			Register = 0x01,	// <nickname>
+			List = 0x02,
+			Offer = 0x03,		// <id>
+			Message = 0x04,		// <message>
+			EndGame = 0x05,
+			Batch = 0x06,		// <count> (<request frame>)...
+			// ^ commands from the player ^
+
+			// v messages from the server v
+			Response = 0x80,
+			PlayerId = 0x81,	// <id>
+			PlayerList = 0x82,	// <count> (<id> <nickname>)...
+			NewOffer = 0x83,	// <id>
+			GameStarted = 0x84,	// <opponent id>
+			GameEnded = 0x85,
+			NewMessage = 0x86,	// <message>
+			// ^ messages from the server ^
+		};
+
+		enum class Status : uint8_t
+		{
+			Success = 0,
+			Error = 1,
+		};
+
+		//      
+		class FrameWriter
+		{
+			std::string& out;
+		public:
+			explicit FrameWriter(std::string& out) : out(out) {}
+
+			void WriteByte(uint8_t value)
+			{
+				out.push_back(static_cast<char>(value));
+			}
+			void WriteVarint(uint64_t value)
+			{
+				while (value >= 0x80)
+				{
+					out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+					value >>= 7;
+				}
+				out.push_back(static_cast<char>(value));
+			}
+			void WriteString(std::string_view value)
+			{
+				WriteVarint(value.size());
+				out.append(value);
+			}
+		};
+
+		/*
+		*     ,    view  
+		*   false,        
+		*/
+		class FrameReader
+		{
+			std::string_view data;
+		public:
+			explicit FrameReader(std::string_view data) : data(data) {}
+
+			bool ReadByte(uint8_t& value)
+			{
+				if (data.empty())
+					return false;
+
+				value = static_cast<uint8_t>(data.front());
+				data.remove_prefix(1);
+				return true;
+			}
+			bool ReadVarint(uint64_t& value)
+			{
+				value = 0;
+				for (int shift = 0; shift < 64; shift += 7)
+				{
+					uint8_t byte;
+					if (!ReadByte(byte))
+						return false;
+
+					value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+					if (!(byte & 0x80))
+						return true;
+				}
+				return false;
+			}
+			bool ReadString(std::string_view& value)
+			{
+				uint64_t size;
+				if (!ReadVarint(size) || size > data.size())
+					return false;
+
+				value = data.substr(0, static_cast<size_t>(size));
+				data.remove_prefix(static_cast<size_t>(size));
+				return true;
+			}
+
+			bool AtEnd() const
+			{
+				return data.empty();
+			}
+		};
+	}
+}